@@ -0,0 +1,116 @@
+import matplotlib
+matplotlib.use('agg')
+import matplotlib.pyplot as plt
+import numpy as np
+
+# Plot the scaling efficiency from the results of run_scaling_local.sh.
+# Throughput should grow linearly with the number of cores for both
+# strong and weak scaling, so the efficiency of each case is its Figure
+# of Merit per core divided by that of the smallest core count in the
+# same series. A second plot shows where the time goes at each core count.
+
+results_dir = 'scaling_local_results/'
+
+header = []
+rows = []
+
+for line in open(results_dir + 'results.txt'):
+
+    words = line.split()
+
+    if len(words) == 0:
+        continue
+
+    if words[0] == '#':
+        if len(words) > 1 and words[1] == 'mode':
+            header = words[1:]
+        continue
+
+    rows.append(words)
+
+phases = header[6:]
+
+def column(name):
+    return header.index(name)
+
+for mode in ['strong', 'weak']:
+
+    # A series is one n_cell (strong scaling) or one n_cell per core (weak
+    # scaling), with one max_box_size and one number of threads per rank.
+
+    series = {}
+
+    for row in rows:
+
+        if row[column('mode')] != mode:
+            continue
+
+        ranks = int(row[column('ranks')])
+        threads = int(row[column('threads')])
+        n_cell = int(row[column('n_cell')])
+        max_box_size = int(row[column('max_box_size')])
+        fom = float(row[column('FOM')])
+        times = [float(row[column(phase)]) for phase in phases]
+
+        if mode == 'strong':
+            key = 'n_cell = {}, max_box_size = {}, {} thread(s)'.format(n_cell, max_box_size, threads)
+        else:
+            key = 'max_box_size = {}, {} thread(s)'.format(max_box_size, threads)
+
+        series.setdefault(key, []).append((ranks * threads, fom, times))
+
+    if len(series) == 0:
+        continue
+
+    plt.figure()
+
+    for key in sorted(series):
+
+        data = sorted(series[key])
+
+        cores = np.array([d[0] for d in data])
+        fom = np.array([d[1] for d in data])
+
+        efficiency = (fom / cores) / (fom[0] / cores[0])
+
+        plt.plot(cores, efficiency, marker='o', markersize=6, linestyle='--', lw=2, label=key)
+
+    plt.xscale('log')
+    plt.ylim([0, 1.2])
+    plt.axhline(1.0, color='k', lw=1)
+    plt.tick_params(labelsize=12)
+    plt.ylabel('Parallel efficiency', fontsize=14)
+    plt.xlabel('Number of cores (MPI ranks x OpenMP threads)', fontsize=14)
+    plt.title('{} scaling of mini-Castro'.format(mode.capitalize()), fontsize=14)
+    plt.legend(loc='best', fontsize=8)
+
+    plt.savefig(results_dir + '{}_scaling.png'.format(mode))
+
+    # Time per phase for the series with the most core counts.
+
+    key = max(series, key=lambda k: len(series[k]))
+    data = sorted(series[key])
+
+    cores = [d[0] for d in data]
+    bottom = np.zeros(len(data))
+
+    plt.figure()
+
+    for n, phase in enumerate(phases):
+
+        times = np.array([d[2][n] for d in data])
+
+        if times.max() == 0.0:
+            continue
+
+        plt.bar(range(len(data)), times, bottom=bottom, label=phase)
+        bottom += times
+
+    plt.xticks(range(len(data)), cores)
+    plt.tick_params(labelsize=12)
+    plt.ylabel('Time (s)', fontsize=14)
+    plt.xlabel('Number of cores', fontsize=14)
+    plt.title('{} scaling: {}'.format(mode.capitalize(), key), fontsize=10)
+    plt.legend(loc='best', fontsize=8)
+
+    plt.savefig(results_dir + '{}_scaling_phases.png'.format(mode))
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Run the same problem with several sets of runtime options and compare
+# the Figure of Merit, the time to solution and the final blast radius
+# (to check that the answers agree). Each entry of OPTIONS_LIST is one
+# set of options; use commas to combine several options in one entry,
+# e.g.
+#
+#   OPTIONS_LIST="aos_eos=0 aos_eos=1" ./run_comparison.sh
+#   OPTIONS_LIST="aos_eos=0 aos_eos=1,max_box_size=32" ./run_comparison.sh
+#
+# The executable is taken from EXE, or from "make print-executable" with
+# any arguments to this script passed to make. The problem setup and
+# launcher can be changed through the environment:
+#
+#   N_CELL=128 MAX_STEP=20 RUN_CMD="mpiexec -n 4" ./run_comparison.sh USE_OMP=TRUE
+
+dir=comparison_results
+
+mkdir -p $dir
+
+options_list=${OPTIONS_LIST:-"aos_eos=0 aos_eos=1"}
+
+n_cell=${N_CELL:-128}
+max_box_size=${MAX_BOX_SIZE:-64}
+max_step=${MAX_STEP:-20}
+run_cmd=${RUN_CMD:-""}
+
+Castro_ex=${EXE:-$(make "$@" print-executable | grep "executable is" | awk '{print $NF}' | tr -d "'")}
+
+case $Castro_ex in
+    */*) ;;
+    *) Castro_ex=./$Castro_ex ;;
+esac
+
+if [ ! -x "$Castro_ex" ]; then
+    echo "Could not find the executable $Castro_ex; build it first"
+    exit 1
+fi
+
+results=$dir/results.txt
+
+echo "# $Castro_ex: n_cell = $n_cell, max_box_size = $max_box_size, max_step = $max_step" > $results
+printf "%-40s%-32s%-24s%s\n" "# Options" "Figure of Merit (zones/usec)" "Time to solution (s)" "Final blast radius (km)" >> $results
+
+for options in $options_list
+do
+
+    args=$(echo $options | tr "," " ")
+    label=$(echo $options | tr ",=" "_-")
+
+    output=$dir/mini-Castro.$label.out
+
+    echo "Running $Castro_ex with $args"
+
+    $run_cmd $Castro_ex n_cell=$n_cell max_box_size=$max_box_size max_step=$max_step $args > $output 2>&1
+
+    fom=$(grep "Figure of Merit (zones" $output | awk '{print $NF}')
+    tts=$(grep "Time to solution" $output | awk '{print $NF}')
+    radius=$(grep "Blast radius" $output | tail -1 | awk '{print $(NF-1)}')
+
+    if [ -z "$fom" ]; then
+        echo "Run failed for $options; see $output"
+        continue
+    fi
+
+    printf "%-40s%-32s%-24s%s\n" "$options" "$fom" "$tts" "$radius" >> $results
+
+done
+
+cat $results
@@ -0,0 +1,61 @@
+#!/bin/bash
+
+# Measure how throughput scales with the number of species (and hence
+# with the number of state components streamed through memory). For
+# every species count in nspec_list we build mini-Castro with
+# NSPEC=<n>, run the same problem, and collect the Figure of Merit.
+#
+# Any arguments are passed to make, e.g.
+#
+#   ./run_nspec_sweep.sh COMP=gnu USE_OMP=TRUE
+#
+# The problem setup and launcher can be changed through the environment:
+#
+#   NSPEC_LIST="1 4 13 30" N_CELL=128 MAX_STEP=20 RUN_CMD="mpiexec -n 4" ./run_nspec_sweep.sh
+
+dir=nspec_results
+
+mkdir -p $dir
+
+nspec_list=${NSPEC_LIST:-"1 2 4 7 13 19 25 30 40"}
+
+n_cell=${N_CELL:-128}
+max_box_size=${MAX_BOX_SIZE:-64}
+max_step=${MAX_STEP:-20}
+run_cmd=${RUN_CMD:-""}
+
+results=$dir/results.txt
+
+echo "# n_cell = $n_cell, max_box_size = $max_box_size, max_step = $max_step" > $results
+echo "# Number of species     Figure of Merit (zones/usec)" >> $results
+
+for nspec in $nspec_list
+do
+
+    echo "Building with NSPEC = $nspec"
+
+    if ! make -j 4 NSPEC=$nspec "$@" > $dir/build.nspec.$nspec.out 2>&1; then
+        echo "Build failed for NSPEC = $nspec; see $dir/build.nspec.$nspec.out"
+        continue
+    fi
+
+    Castro_ex=$(make NSPEC=$nspec "$@" print-executable | grep "executable is" | awk '{print $NF}' | tr -d "'")
+
+    output=$dir/mini-Castro.nspec.$nspec.out
+
+    echo "Running $Castro_ex"
+
+    $run_cmd ./$Castro_ex n_cell=$n_cell max_box_size=$max_box_size max_step=$max_step > $output 2>&1
+
+    fom=$(grep "Figure of Merit" $output | awk '{print $NF}')
+
+    if [ -z "$fom" ]; then
+        echo "Run failed for NSPEC = $nspec; see $output"
+        continue
+    fi
+
+    printf "%-24s%s\n" $nspec $fom >> $results
+
+done
+
+cat $results
@@ -0,0 +1,142 @@
+#!/bin/bash
+
+# Weak and strong scaling sweeps on a local Linux node (or a small set
+# of nodes reachable by mpirun), without a batch system. For every
+# combination of MPI ranks and OpenMP threads we run:
+#
+#   strong scaling: every n_cell in STRONG_N_CELL_LIST, unchanged as the
+#                   number of cores grows;
+#   weak scaling:   WEAK_N_CELL zones per dimension on one core, with
+#                   n_cell grown with the cube root of the core count
+#                   (rounded to a multiple of MIN_BOX_SIZE), so that the
+#                   number of zones per core stays roughly constant;
+#
+# each with every max_box_size in MAX_BOX_SIZE_LIST. The Figure of Merit
+# and the run time of each AMR phase (amr_timing = 1) are collected into
+# a single results file, which plot_scaling_local.py turns into scaling
+# efficiency plots.
+#
+# Any arguments are passed to make, e.g.
+#
+#   ./run_scaling_local.sh COMP=gnu USE_MPI=TRUE USE_OMP=TRUE
+#
+# The sweep and the launcher can be changed through the environment:
+#
+#   RANKS_LIST="1 2 4 8" THREADS_LIST="1 2" MPIRUN="mpirun --bind-to core" ./run_scaling_local.sh USE_MPI=TRUE
+
+dir=scaling_local_results
+
+mkdir -p $dir
+
+ranks_list=${RANKS_LIST:-"1 2 4 8"}
+threads_list=${THREADS_LIST:-"1"}
+strong_n_cell_list=${STRONG_N_CELL_LIST:-"128 256"}
+weak_n_cell=${WEAK_N_CELL:-64}
+max_box_size_list=${MAX_BOX_SIZE_LIST:-"32 64"}
+min_box_size=${MIN_BOX_SIZE:-16}
+max_step=${MAX_STEP:-20}
+mpirun=${MPIRUN:-mpirun}
+
+Castro_ex=${EXE:-$(make "$@" print-executable | grep "executable is" | awk '{print $NF}' | tr -d "'")}
+
+case $Castro_ex in
+    */*) ;;
+    *) Castro_ex=./$Castro_ex ;;
+esac
+
+if [ ! -x "$Castro_ex" ]; then
+    echo "Could not find the executable $Castro_ex; build it first"
+    exit 1
+fi
+
+results=$dir/results.txt
+
+phases="FillPatch hydro flux_reg reflux avg_down sync_clean regrid"
+
+echo "# $Castro_ex: max_step = $max_step" > $results
+echo "# Times are in seconds (maximum over MPI ranks), summed over the AMR levels" >> $results
+printf "%-8s%-8s%-10s%-8s%-14s%-12s" "# mode" "ranks" "threads" "n_cell" "max_box_size" "FOM" >> $results
+for phase in $phases
+do
+    printf "%-12s" $phase >> $results
+done
+printf "\n" >> $results
+
+run_case () {
+
+    mode=$1
+    ranks=$2
+    threads=$3
+    n_cell=$4
+    max_box_size=$5
+
+    if [ $max_box_size -gt $n_cell ]; then
+        return
+    fi
+
+    label=$mode.nmpi.$ranks.nomp.$threads.ncell.$n_cell.grid.$max_box_size
+
+    output=$dir/mini-Castro.$label.out
+
+    echo "Running $mode scaling case: $ranks ranks, $threads threads, n_cell = $n_cell, max_box_size = $max_box_size"
+
+    $mpirun -np $ranks env OMP_NUM_THREADS=$threads $Castro_ex \
+        n_cell=$n_cell max_box_size=$max_box_size min_box_size=$min_box_size \
+        max_step=$max_step amr_timing=1 > $output 2>&1
+
+    fom=$(grep "Figure of Merit (zones" $output | awk '{print $NF}')
+
+    if [ -z "$fom" ]; then
+        echo "Run failed; see $output"
+        return
+    fi
+
+    # Sum the time of each phase over the levels in the breakdown of the run.
+
+    times=$(awk -v phases="$phases" '
+        /AMR phase breakdown of the run/ { table = 1; next }
+        table && NF == 0 && started { table = 0 }
+        table && $1 ~ /^[0-9]+$/ && NF >= 4 {
+            started = 1
+            name = $2
+            for (n = 3; n <= NF - 2; ++n) name = name "_" $n
+            t[name] += $(NF-1)
+        }
+        END {
+            np = split(phases, p, " ")
+            for (n = 1; n <= np; ++n) printf "%-12.4f", t[p[n]]
+        }' $output)
+
+    printf "%-8s%-8s%-10s%-8s%-14s%-12s%s\n" $mode $ranks $threads $n_cell $max_box_size $fom "$times" >> $results
+
+}
+
+for ranks in $ranks_list
+do
+
+    for threads in $threads_list
+    do
+
+        ncores=$((ranks * threads))
+
+        for n_cell in $strong_n_cell_list
+        do
+            for max_box_size in $max_box_size_list
+            do
+                run_case strong $ranks $threads $n_cell $max_box_size
+            done
+        done
+
+        n_cell=$(awk -v n=$weak_n_cell -v p=$ncores -v b=$min_box_size \
+                 'BEGIN { m = int(n * p^(1.0/3.0) / b + 0.5); if (m < 1) m = 1; print m * b }')
+
+        for max_box_size in $max_box_size_list
+        do
+            run_case weak $ranks $threads $n_cell $max_box_size
+        done
+
+    done
+
+done
+
+cat $results
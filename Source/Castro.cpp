@@ -2,6 +2,9 @@
 #include <vector>
 #include <iostream>
 #include <string>
+#include <cstdint>
+#include <set>
+#include <fstream>
 
 #include <AMReX_Utility.H>
 #include <Castro.H>
@@ -13,10 +16,60 @@
 #include <omp.h>
 #endif
 
+#if defined(__linux__) && !defined(AMREX_USE_GPU)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 using namespace amrex;
 
 Real Castro::num_zones_advanced = 0.0;
+Real Castro::num_zones_equivalent = 0.0;
 int Castro::diagnostic_interval = 50;
+int Castro::aos_eos = 0;
+int Castro::eos_stats = 0;
+int Castro::eos_bracketed_newton = 0;
+int Castro::eos_temp_extrapolation = 0;
+int Castro::eos_fast_math = 0;
+int Castro::eos_validate = 0;
+int Castro::riemann_solver = 0;
+int Castro::ppm_type = 1;
+int Castro::do_ctu = 1;
+int Castro::adaptive_regrid = 0;
+int Castro::regrid_margin = 1;
+int Castro::num_regrids = 0;
+Real Castro::regrid_time = 0.0;
+int Castro::num_tag_fills = 0;
+Real Castro::tag_fill_time = 0.0;
+Real Castro::regrid_start_time = -1.0;
+int Castro::dynamic_tiling = 0;
+int Castro::thread_timing = 0;
+int Castro::numa_first_touch = 0;
+int Castro::huge_pages = 0;
+int Castro::amr_timing = 0;
+int Castro::comm_stats = 0;
+int Castro::active_species = 0;
+int Castro::num_active_species = 0;
+Real Castro::exp_energy = 1.0e52;
+int Castro::ensemble_member = -1;
+int Castro::num_hierarchies = 0;
+Vector<Real> Castro::thread_busy_time;
+Vector<Real> Castro::thread_wait_time;
+Vector<Real> Castro::thread_done_time;
+Vector<Real> Castro::amr_phase_time;
+Vector<Real> Castro::amr_phase_zones;
+Vector<Real> Castro::amr_step_time;
+Vector<Real> Castro::amr_step_zones;
+Real Castro::startup_phase_time[NUM_STARTUP_PHASES] = {0.0};
+Real Castro::comm_step_bytes = 0.0;
+Real Castro::comm_step_full_bytes = 0.0;
+Real Castro::comm_step_messages = 0.0;
+Real Castro::comm_step_time = 0.0;
+Real Castro::comm_bytes = 0.0;
+Real Castro::comm_full_bytes = 0.0;
+Real Castro::comm_messages = 0.0;
+Real Castro::comm_time = 0.0;
+int Castro::comm_steps = 0;
 
 // Choose tile size based on whether we're using a GPU.
 
@@ -29,6 +82,11 @@ IntVect Castro::tile_size(1024, 16, 16);
 void
 Castro::variableCleanUp ()
 {
+    // The data descriptors and the EOS are shared by all Amr
+    // hierarchies in the run, so only the last one cleans them up.
+
+    if (--num_hierarchies > 0) return;
+
     desc_lst.clear();
 
     eos_finalize();
@@ -46,23 +104,43 @@ Castro::Castro (Amr&            papa,
 
     BL_PROFILE("Castro::Castro()");
 
-    // Initialize volume, area, flux arrays.
+    define_level_data();
 
-    volume.clear();
-    volume.define(grids, dmap, 1, 4);
-    geom.GetVolume(volume);
+    composition.define(grids, dmap, NUM_COMP, 0);
+
+    compute_exchange_volume();
+
+    first_touch(get_new_data(State_Type));
+    first_touch(composition);
+
+}
+
+void
+Castro::define_level_data ()
+{
+    // Initialize volume, area, flux arrays. On a uniform Cartesian
+    // grid the volume and area are constants computed from dx in the
+    // kernels, so we only need the MultiFabs for other geometries.
+
+    if (!geom.IsCartesian()) {
+
+        volume.clear();
+        volume.define(grids, dmap, 1, 4);
+        geom.GetVolume(volume);
+
+        for (int dir = 0; dir < BL_SPACEDIM; dir++)
+        {
+            area[dir].clear();
+            area[dir].define(getEdgeBoxArray(dir), dmap, 1, 4);
+            geom.GetFaceArea(area[dir],dir);
+        }
 
-    for (int dir = 0; dir < BL_SPACEDIM; dir++)
-    {
-        area[dir].clear();
-	area[dir].define(getEdgeBoxArray(dir), dmap, 1, 4);
-        geom.GetFaceArea(area[dir],dir);
     }
 
-    fluxes.resize(3);
+    // The flux MultiFabs are allocated in advance(), and only if this
+    // level has a coarse-fine interface that needs them.
 
-    for (int dir = 0; dir < BL_SPACEDIM; ++dir)
-	fluxes[dir].reset(new MultiFab(getEdgeBoxArray(dir), dmap, NUM_STATE, 0));
+    fluxes.resize(3);
 
     if (level > 0) {
 
@@ -70,7 +148,68 @@ Castro::Castro (Amr&            papa,
 	flux_reg.setVal(0.0);
 
     }
+}
+
+void
+Castro::restart (Amr&          papa,
+                 std::istream& is,
+                 bool          bReadSpecial)
+{
+    AmrLevel::restart(papa, is, bReadSpecial);
+
+    // The temperature used to be stored right after the internal energy;
+    // it is now the last component. Reading a checkpoint written with a
+    // different order would silently mix up the components, so refuse to.
+
+    if (level == 0) {
+
+        std::ifstream header(papa.theRestartFile() + "/CastroHeader");
+
+        int ncomp = 0;
+        std::string name;
+
+        header >> name >> ncomp;
+
+        if (!header || name != "NUM_STATE")
+            amrex::Abort("Castro::restart: " + papa.theRestartFile() +
+                         " has no CastroHeader, so its state components may be in a different order; it can't be restarted");
+
+        bool match = ncomp == NUM_STATE;
+
+        for (int n = 0; n < ncomp && match; ++n) {
+            header >> name;
+            match = header && name == desc_lst[State_Type].name(n);
+        }
+
+        if (!match)
+            amrex::Abort("Castro::restart: the state components of " + papa.theRestartFile() +
+                         " are not those of this executable (see CastroHeader)");
+
+    }
+
+    define_level_data();
+}
+
+void
+Castro::checkPoint (const std::string& dir,
+                    std::ostream&      os,
+                    VisMF::How         how,
+                    bool               dump_old)
+{
+    AmrLevel::checkPoint(dir, os, how, dump_old);
 
+    // Record the state components, in order, for restart to check.
+
+    if (level == 0 && ParallelDescriptor::IOProcessor()) {
+
+        std::ofstream header(dir + "/CastroHeader");
+
+        header << "NUM_STATE " << NUM_STATE << std::endl;
+
+        for (int n = 0; n < NUM_STATE; ++n)
+            header << desc_lst[State_Type].name(n) << std::endl;
+
+    }
 }
 
 Castro::~Castro ()
@@ -82,6 +221,8 @@ Castro::initData ()
 {
     BL_PROFILE("Castro::initData()");
 
+    const Real init_start = ParallelDescriptor::second();
+
     // Loop over grids and initialize data.
 
     const auto dx = geom.CellSizeArray();
@@ -90,6 +231,8 @@ Castro::initData ()
     MultiFab& S_new = get_new_data(State_Type);
     Real cur_time   = state[State_Type].curTime();
 
+    const Real energy = exp_energy;
+
     S_new.setVal(0.);
 
     // make sure dx = dy = dz -- that's all we guarantee to support
@@ -107,13 +250,18 @@ Castro::initData ()
         const Box& box = mfi.tilebox();
         auto state_arr = S_new[mfi].array();
 
-        CASTRO_LAUNCH_LAMBDA(box, lbx,
+        CASTRO_LAUNCH_LAMBDA("initdata", box, lbx,
         {
             initdata(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                      AMREX_ARR4_TO_FORTRAN_ANYD(state_arr), AMREX_ZFILL(dx.data()),
-                     AMREX_ZFILL(problo.data()), AMREX_ZFILL(probhi.data()));
+                     AMREX_ZFILL(problo.data()), AMREX_ZFILL(probhi.data()),
+                     energy);
         });
     }
+
+    update_composition();
+
+    startup_phase_done(InitData_Startup, init_start);
 }
 
 void
@@ -134,6 +282,8 @@ Castro::init (AmrLevel &old)
 
     MultiFab& state_MF = get_new_data(State_Type);
     FillPatch(old, state_MF, state_MF.nGrow(), cur_time, State_Type, 0, state_MF.nComp());
+
+    update_composition();
 }
 
 //
@@ -157,6 +307,8 @@ Castro::init ()
 
     MultiFab& state_MF = get_new_data(State_Type);
     FillCoarsePatch(state_MF, 0, cur_time, State_Type, 0, state_MF.nComp());
+
+    update_composition();
 }
 
 Real
@@ -176,6 +328,7 @@ Real
 Castro::estTimeStep (Real dt_old)
 {
     BL_PROFILE("Castro::estTimeStep()");
+    CASTRO_TRACE_REGION("estTimeStep");
 
     const MultiFab& stateMF = get_new_data(State_Type);
 
@@ -185,31 +338,84 @@ Castro::estTimeStep (Real dt_old)
 
     *dt_loc = std::numeric_limits<amrex::Real>::max();
 
+    // The number of components in the zone-interleaved copy for estdt_aos.
+
+    int ndt = 0;
+
+    if (aos_eos)
+        estdt_aos_size(&ndt);
+
+    const Real region_start = thread_region_start();
+
 #ifdef AMREX_USE_OMP
 #pragma omp parallel
 #endif
-    for (MFIter mfi(stateMF, tile_size); mfi.isValid(); ++mfi)
+    {
+    for (MFIter mfi(stateMF, tile_info()); mfi.isValid(); ++mfi)
     {
         const Box& box = mfi.tilebox();
 
         auto state_arr = stateMF[mfi].array();
+        auto comp_arr = composition[mfi].array();
 
-        CASTRO_LAUNCH_LAMBDA(box, lbx,
-        {
-            estdt(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                  AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
-                  AMREX_ZFILL(dx.data()), dt_loc);
-        });
+        if (aos_eos) {
+
+            // Only the density, momenta, internal energy and temperature
+            // are needed here, so only those are copied.
+
+            FArrayBox state_aos_fab(box, ndt);
+            Elixir elix_state_aos = state_aos_fab.elixir();
+            auto state_aos = state_aos_fab.array();
+
+            CASTRO_LAUNCH_LAMBDA("estdt_to_aos", box, lbx,
+            {
+                estdt_to_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                             AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
+                             AMREX_ARR4_TO_FORTRAN_ANYD(state_aos));
+            });
+
+            CASTRO_LAUNCH_LAMBDA("estdt_aos", box, lbx,
+            {
+                estdt_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(state_aos),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(comp_arr),
+                          AMREX_ZFILL(dx.data()), dt_loc);
+            });
+
+        }
+        else {
+
+            CASTRO_LAUNCH_LAMBDA("estdt", box, lbx,
+            {
+                estdt(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(comp_arr),
+                      AMREX_ZFILL(dx.data()), dt_loc);
+            });
+
+        }
+    }
+
+    thread_loop_done(region_start);
     }
 
+    thread_region_done();
+
     Real dt = *dt_loc;
 
     amrex::The_Managed_Arena()->free(dt_loc);
 
     // Reduce over all MPI ranks.
-    ParallelDescriptor::ReduceRealMin(dt);
+    {
+        CASTRO_TRACE_REGION("estTimeStep reduce");
+        ParallelDescriptor::ReduceRealMin(dt);
+    }
+
+    // The CTU update is stable up to a CFL number of one in each
+    // direction separately. The unsplit MOL update is only stable when
+    // the Courant numbers of the three directions sum to less than one.
 
-    const Real cfl = 0.5;
+    const Real cfl = do_ctu ? 0.5 : 1.0 / 3.0;
     dt *= cfl;
 
     return dt;
@@ -310,6 +516,8 @@ Castro::computeInitialDt (int                   finest_level,
     if (level > 0)
         return;
 
+    const Real first_dt_start = ParallelDescriptor::second();
+
     int i;
 
     Real dt_0 = 1.0e+100;
@@ -338,6 +546,8 @@ Castro::computeInitialDt (int                   finest_level,
         n_factor *= n_cycle[i];
         dt_level[i] = dt_0/n_factor;
     }
+
+    startup_phase_done(FirstDt_Startup, first_dt_start);
 }
 
 void
@@ -353,82 +563,233 @@ Castro::post_timestep (int iteration)
 
     // Now do the refluxing.
 
-    if (level < parent->finestLevel())
+    if (level < parent->finestLevel()) {
+        const Real reflux_start = amr_phase_start();
 	reflux(level, level+1);
+        if (amr_timing)
+            amr_phase_done(level, Reflux_Phase, reflux_start, getLevel(level+1).coarse_fine_faces());
+    }
 
     // Ensure consistency with finer grids.
 
-    if (level < finest_level)
+    if (level < finest_level) {
+        const Real avgdown_start = amr_phase_start();
 	avgDown();
+        if (amr_timing)
+            amr_phase_done(level, AvgDown_Phase, avgdown_start, amrex::coarsen(getLevel(level+1).grids, fine_ratio).numPts());
+    }
 
     MultiFab& S_new = get_new_data(State_Type);
 
     // Clean up any aberrant state data generated by the reflux and average-down,
     // and then update quantities like temperature to be consistent.
 
-    clean_state(S_new);
+    const Real clean_start = amr_phase_start();
+
+    clean_state(S_new, composition);
+
+    if (amr_timing)
+        amr_phase_done(level, SyncClean_Phase, clean_start, 0);
+
+    if (level == 0 && eos_stats)
+        print_eos_step_stats(parent->levelSteps(0));
+
+    if (level == 0 && amr_timing > 1)
+        print_amr_step_timing(parent->levelSteps(0));
+
+    if (level == 0 && comm_stats)
+        print_comm_step_stats(parent->levelSteps(0));
 
     if (level == 0 && parent->levelSteps(0) % diagnostic_interval == 0)
     {
         // As a diagnostic quantity, we'll print the current blast radius
-        // (the location of the shock). We can estimate this using the
-        // location where the density on the domain is maximum. Then we
-        // can refine the estimate by doing a weighted sum on the domain.
+        // (the location of the shock).
+
+        Real radius = blast_radius();
+
+        if (ensemble_member >= 0)
+            amrex::Print() << "Member " << ensemble_member << ": ";
+
+        amrex::Print() << std::scientific << std::setprecision(6) << "Blast radius at step " << parent->levelSteps(0) << ", time " << state[State_Type].curTime()
+                       << ": " << std::fixed << std::setprecision(3) << radius / 1.0e5 << " km" << std::endl;
+    }
+
+}
 
-        // We'll assume that everything we care about is on the finest level.
-        MultiFab& S_new = getLevel(parent->finestLevel()).get_new_data(State_Type);
-        Real max_density = S_new.max(Density);
+Real
+Castro::blast_radius ()
+{
+    BL_PROFILE("Castro::blast_radius()");
+    CASTRO_TRACE_REGION("blast_radius");
+
+    // We can estimate the location of the shock using the location
+    // where the density on the domain is maximum. Then we can refine
+    // the estimate by doing a weighted sum on the domain.
+
+    // We'll assume that everything we care about is on the finest level.
+    MultiFab& S_new = getLevel(parent->finestLevel()).get_new_data(State_Type);
+    Real max_density = S_new.max(Density);
 
-        const auto dx = getLevel(parent->finestLevel()).geom.CellSizeArray();
-        const auto problo = geom.ProbLoArray();
-        const auto probhi = geom.ProbHiArray();
+    const auto dx = getLevel(parent->finestLevel()).geom.CellSizeArray();
+    const auto problo = geom.ProbLoArray();
+    const auto probhi = geom.ProbHiArray();
 
-        // Get device pointers to the reduction variables.
-        Real* blast_mass_loc = static_cast<Real*>(amrex::The_Managed_Arena()->alloc(sizeof(Real)));
-        Real* blast_radius_loc = static_cast<Real*>(amrex::The_Managed_Arena()->alloc(sizeof(Real)));
+    // Get device pointers to the reduction variables.
+    Real* blast_mass_loc = static_cast<Real*>(amrex::The_Managed_Arena()->alloc(sizeof(Real)));
+    Real* blast_radius_loc = static_cast<Real*>(amrex::The_Managed_Arena()->alloc(sizeof(Real)));
 
-        *blast_mass_loc = 0.0;
-        *blast_radius_loc = 0.0;
+    *blast_mass_loc = 0.0;
+    *blast_radius_loc = 0.0;
 
 #ifdef AMREX_USE_OMP
 #pragma omp parallel
 #endif
-        for (MFIter mfi(S_new, tile_size); mfi.isValid(); ++mfi)
-        {
-            const Box& box = mfi.tilebox();
+    for (MFIter mfi(S_new, tile_size); mfi.isValid(); ++mfi)
+    {
+        const Box& box = mfi.tilebox();
 
-            auto state_arr = S_new[mfi].array();
+        auto state_arr = S_new[mfi].array();
 
-            CASTRO_LAUNCH_LAMBDA(box, lbx,
-            {
-                calculate_blast_radius(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                                       AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
-                                       AMREX_ZFILL(dx.data()), AMREX_ZFILL(problo.data()), AMREX_ZFILL(probhi.data()),
-                                       blast_mass_loc, blast_radius_loc, max_density);
-            });
+        CASTRO_LAUNCH_LAMBDA("calculate_blast_radius", box, lbx,
+        {
+            calculate_blast_radius(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                                   AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
+                                   AMREX_ZFILL(dx.data()), AMREX_ZFILL(problo.data()), AMREX_ZFILL(probhi.data()),
+                                   blast_mass_loc, blast_radius_loc, max_density);
+        });
 
-        }
+    }
 
-        Real blast_mass = *blast_mass_loc;
-        Real blast_radius = *blast_radius_loc;
+    Real blast_mass = *blast_mass_loc;
+    Real blast_mass_radius = *blast_radius_loc;
 
-        amrex::The_Managed_Arena()->free(blast_mass_loc);
-        amrex::The_Managed_Arena()->free(blast_radius_loc);
+    amrex::The_Managed_Arena()->free(blast_mass_loc);
+    amrex::The_Managed_Arena()->free(blast_radius_loc);
 
-        // Reduce over MPI ranks.
+    // Reduce over MPI ranks.
+    {
+        CASTRO_TRACE_REGION("blast_radius reduce");
         amrex::ParallelDescriptor::ReduceRealSum(blast_mass);
-        amrex::ParallelDescriptor::ReduceRealSum(blast_radius);
-
-        amrex::Print() << std::scientific << std::setprecision(6) << "Blast radius at step " << parent->levelSteps(0) << ", time " << state[State_Type].curTime()
-                       << ": " << std::fixed << std::setprecision(3) << (blast_radius / blast_mass) / 1.0e5 << " km" << std::endl;
+        amrex::ParallelDescriptor::ReduceRealSum(blast_mass_radius);
     }
 
+    return blast_mass_radius / blast_mass;
 }
 
 void
 Castro::post_regrid (int lbase, int new_finest)
 {
     BL_PROFILE("Castro::post_regrid()");
+
+    // The regrid is complete once the finest level has been rebuilt.
+
+    if (level == new_finest) {
+
+        num_regrids++;
+
+        if (regrid_start_time >= 0.0) {
+
+            if (amr_timing) {
+
+                // The regrid fills the state on every level above lbase.
+
+                Long nzones = 0;
+                for (int lev = lbase + 1; lev <= new_finest; ++lev)
+                    nzones += getLevel(lev).grids.numPts();
+
+                amr_phase_done(lbase, Regrid_Phase, regrid_start_time, nzones);
+
+            }
+
+            regrid_time += ParallelDescriptor::second() - regrid_start_time;
+            regrid_start_time = -1.0;
+        }
+
+    }
+}
+
+int
+Castro::okToRegrid ()
+{
+    BL_PROFILE("Castro::okToRegrid()");
+
+    int regrid = 1;
+
+    // If we are regridding adaptively, check whether any zone that would be
+    // tagged for refinement is within regrid_margin zones of the edge of
+    // the next finer level. If none are, the existing fine grids still
+    // cover the features we care about and we can skip this regrid.
+
+    if (adaptive_regrid && level < parent->finestLevel()) {
+
+        const int margin = regrid_margin;
+
+        BoxArray fine_grids = getLevel(level+1).boxArray();
+        fine_grids.coarsen(fine_ratio);
+
+        const Box& domain = geom.Domain();
+
+        // The density with one ghost zone, as in errorEst. If we do
+        // regrid, errorEst tags on this same copy.
+
+        MultiFab& den_mf = tagging_density(get_state_data(State_Type).curTime());
+
+        Real* num_near_loc = static_cast<Real*>(amrex::The_Managed_Arena()->alloc(sizeof(Real)));
+
+        *num_near_loc = 0.0;
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+        for (MFIter mfi(den_mf, tile_size); mfi.isValid(); ++mfi)
+        {
+            const Box& box = mfi.tilebox();
+            const Box& mbox = amrex::grow(box, margin);
+
+            // Mark the zones covered by the finer level. Zones outside
+            // the domain are not an edge of the refined region, so mark
+            // those as well.
+
+            IArrayBox mask_fab(mbox, 1);
+            Elixir elix_mask = mask_fab.elixir();
+
+            mask_fab.setVal(0);
+
+            for (const auto& isect : fine_grids.intersections(mbox))
+                mask_fab.setVal(1, isect.second);
+
+            for (const Box& b : amrex::boxDiff(mbox, domain))
+                mask_fab.setVal(1, b);
+
+            auto den = den_mf[mfi].array();
+            auto mask = mask_fab.array();
+
+            CASTRO_LAUNCH_LAMBDA("count_tags_near_edge", box, lbx,
+            {
+                count_tags_near_edge(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                                     AMREX_ARR4_TO_FORTRAN_ANYD(den),
+                                     AMREX_ARR4_TO_FORTRAN_ANYD(mask),
+                                     margin, num_near_loc);
+            });
+        }
+
+        Real num_near = *num_near_loc;
+
+        amrex::The_Managed_Arena()->free(num_near_loc);
+
+        ParallelDescriptor::ReduceRealSum(num_near);
+
+        regrid = num_near > 0.0;
+
+        if (!regrid)
+            tag_density.reset();
+
+    }
+
+    if (regrid)
+        regrid_start_time = ParallelDescriptor::second();
+
+    return regrid;
 }
 
 void
@@ -438,11 +799,41 @@ Castro::post_init (Real stop_time)
 
     if (level > 0) return;
 
+    const Real post_init_start = ParallelDescriptor::second();
+
     // Average data down from finer levels
     // so that conserved data is consistent between levels.
     int finest_level = parent->finestLevel();
-    for (int k = finest_level-1; k>= 0; k--)
+    for (int k = finest_level-1; k>= 0; k--) {
         getLevel(k).avgDown();
+        getLevel(k).update_composition();
+    }
+
+    // Find the species that the initial data needs carried.
+
+    if (active_species)
+        update_active_species();
+
+    startup_phase_done(PostInit_Startup, post_init_start);
+}
+
+void
+Castro::post_restart ()
+{
+    BL_PROFILE("Castro::post_restart()");
+
+    // The composition is not stored in the checkpoint.
+
+    composition.define(grids, dmap, NUM_COMP, 0);
+
+    update_composition();
+
+    // The active species are not stored in the checkpoint either.
+
+    if (level == 0 && active_species)
+        update_active_species();
+
+    compute_exchange_volume();
 }
 
 
@@ -451,6 +842,7 @@ void
 Castro::reflux(int crse_level, int fine_level)
 {
     BL_PROFILE("Castro::reflux()");
+    CASTRO_TRACE_REGION("reflux");
 
     BL_ASSERT(fine_level > crse_level);
 
@@ -474,7 +866,14 @@ Castro::reflux(int crse_level, int fine_level)
 
 	// Trigger the actual reflux on the coarse level now.
 
-	reg->Reflux(state, crse_lev.volume, 1.0, 0, 0, NUM_STATE, crse_lev.geom);
+	// Only the active species have fluxes.
+
+	const int ncomp = FirstSpec + num_active_species;
+
+	if (crse_lev.geom.IsCartesian())
+	    reg->Reflux(state, 1.0, 0, 0, ncomp, crse_lev.geom);
+	else
+	    reg->Reflux(state, crse_lev.volume, 1.0, 0, 0, ncomp, crse_lev.geom);
 
 	// We no longer need the flux register data, so clear it out.
 
@@ -488,6 +887,7 @@ void
 Castro::avgDown ()
 {
     BL_PROFILE("Castro::avgDown()");
+    CASTRO_TRACE_REGION("avgDown");
 
     if (level == parent->finestLevel()) return;
 
@@ -504,90 +904,913 @@ Castro::avgDown ()
                         0, S_fine.nComp(), fine_ratio);
 }
 
-void
-Castro::errorEst (TagBoxArray& tags,
-                  int          clearval,
-                  int          tagval,
-                  Real         time,
-                  int          n_error_buf,
-                  int          ngrow)
+// The EOS iteration totals at the last print_eos_step_stats.
+
+static Real eos_last_calls = 0.0;
+static Real eos_last_iters = 0.0;
+
+// Sum the EOS iteration histograms over threads and ranks. The histogram
+// is stored as hist[caller * nbins + (iterations - 1)].
+
+static Vector<Real>
+eos_iteration_counts (int& nbins, int& ncallers)
 {
-    BL_PROFILE("Castro::errorEst()");
+    eos_iteration_histogram_size(&nbins, &ncallers);
 
-    auto mf = derive("density", time, 1);
+    Vector<Real> hist(nbins * ncallers);
 
-    BL_ASSERT(mf);
+    eos_iteration_histogram(hist.dataPtr());
 
-    const int8_t set   = (int8_t) TagBox::SET;
-    const int8_t clear = (int8_t) TagBox::CLEAR;
-    
-#ifdef AMREX_USE_OMP
-#pragma omp parallel
-#endif
-    for (MFIter mfi(*mf, tile_size); mfi.isValid(); ++mfi)
-    {
-        const Box& box = mfi.tilebox();
-        auto tags_arr = tags[mfi].array();
-        auto data_arr = (*mf)[mfi].array();
+    ParallelDescriptor::ReduceRealSum(hist.dataPtr(), hist.size());
 
-        CASTRO_LAUNCH_LAMBDA(box, lbx,
-        {
-            denerror(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                     (int8_t*) AMREX_ARR4_TO_FORTRAN_ANYD(tags_arr),
-                     AMREX_ARR4_TO_FORTRAN_ANYD(data_arr),
-                     set, clear);
-        });
-    }
+    return hist;
 }
 
-// Given State_Type state data, perform a number of cleaning steps to make
-// sure the data is sensible.
-
 void
-Castro::clean_state(MultiFab& state)
+Castro::print_eos_step_stats (int step)
 {
-    BL_PROFILE("Castro::clean_state()");
+    BL_PROFILE("Castro::print_eos_step_stats()");
 
-    int ng = state.nGrow();
+    int nbins, ncallers;
+    Vector<Real> hist = eos_iteration_counts(nbins, ncallers);
 
-#ifdef AMREX_USE_OMP
-#pragma omp parallel
-#endif
-    for (MFIter mfi(state, tile_size); mfi.isValid(); ++mfi)
-    {
-        const Box& box = mfi.growntilebox(ng);
-        auto state_arr = state[mfi].array();
+    Real calls = 0.0;
+    Real iters = 0.0;
 
-        // Ensure the density is larger than the density floor.
+    for (int c = 0; c < ncallers; ++c) {
+        for (int n = 0; n < nbins; ++n) {
+            calls += hist[c * nbins + n];
+            iters += (n + 1) * hist[c * nbins + n];
+        }
+    }
 
-        CASTRO_LAUNCH_LAMBDA(box, lbx,
-        {
-            enforce_minimum_density(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                                    AMREX_ARR4_TO_FORTRAN_ANYD(state_arr));
-        });
+    const Real step_calls = calls - eos_last_calls;
+    const Real step_iters = iters - eos_last_iters;
 
-        // Ensure all species are normalized.
+    eos_last_calls = calls;
+    eos_last_iters = iters;
 
-        CASTRO_LAUNCH_LAMBDA(box, lbx,
-        {
-            normalize_species(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                              AMREX_ARR4_TO_FORTRAN_ANYD(state_arr));
-        });
+    amrex::Print() << "EOS Newton iterations in step " << step << ": " << std::fixed << std::setprecision(0) << step_iters
+                   << " in " << step_calls << " inversions (" << std::setprecision(3)
+                   << (step_calls > 0.0 ? step_iters / step_calls : 0.0) << " per inversion)" << std::endl;
+}
 
-        // Ensure (rho e) isn't too small or negative
+void
+Castro::print_eos_stats ()
+{
+    BL_PROFILE("Castro::print_eos_stats()");
 
-        CASTRO_LAUNCH_LAMBDA(box, lbx,
-        {
-            reset_internal_e(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                             AMREX_ARR4_TO_FORTRAN_ANYD(state_arr));
-        });
+#ifdef AMREX_USE_CUDA
+    amrex::Print() << "EOS iteration statistics are not collected in GPU builds." << std::endl;
+#else
+    // These must be in the order of the eos_caller_* indices in eos.F90.
+    const std::vector<std::string> callers = {"other", "enforce_min_density", "reset_internal_e",
+                                              "compute_temp", "estdt", "ctoprim"};
 
-        // Make the temperature be consistent with the internal energy.
+    int nbins, ncallers;
+    Vector<Real> hist = eos_iteration_counts(nbins, ncallers);
 
-        CASTRO_LAUNCH_LAMBDA(box, lbx,
-        {
-            compute_temp(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                         AMREX_ARR4_TO_FORTRAN_ANYD(state_arr));
-        });
+    BL_ASSERT(ncallers == callers.size());
+
+    // Group the iteration counts into powers of two.
+
+    const std::vector<int> bin_lo = {1, 2, 3, 5, 9, 17, 33, 65};
+    const int nb = bin_lo.size();
+
+    amrex::Print() << "EOS calls by number of Newton iterations:" << std::endl << std::endl;
+
+    amrex::Print() << std::setw(20) << std::left << "kernel" << std::right
+                   << std::setw(14) << "calls" << std::setw(8) << "mean" << std::setw(6) << "max";
+    for (int b = 0; b < nb; ++b) {
+        const int hi = (b + 1 < nb) ? bin_lo[b+1] - 1 : nbins;
+        const std::string label = (hi == bin_lo[b]) ? std::to_string(hi) : std::to_string(bin_lo[b]) + "-" + std::to_string(hi);
+        amrex::Print() << std::setw(12) << label;
     }
+    amrex::Print() << std::endl;
+
+    for (int c = 0; c < ncallers; ++c) {
+
+        Real calls = 0.0;
+        Real iters = 0.0;
+        int max_iters = 0;
+
+        std::vector<Real> binned(nb, 0.0);
+
+        for (int n = 0; n < nbins; ++n) {
+            const Real count = hist[c * nbins + n];
+            if (count == 0.0) continue;
+
+            calls += count;
+            iters += (n + 1) * count;
+            max_iters = n + 1;
+
+            int b = nb - 1;
+            while (n + 1 < bin_lo[b]) --b;
+            binned[b] += count;
+        }
+
+        if (calls == 0.0) continue;
+
+        amrex::Print() << std::setw(20) << std::left << callers[c] << std::right
+                       << std::setw(14) << std::fixed << std::setprecision(0) << calls
+                       << std::setw(8) << std::setprecision(2) << iters / calls
+                       << std::setw(6) << max_iters;
+        for (int b = 0; b < nb; ++b)
+            amrex::Print() << std::setw(12) << std::setprecision(0) << binned[b];
+        amrex::Print() << std::endl;
+
+    }
+
+    amrex::Print() << std::endl;
+#endif
+}
+
+void
+Castro::validate_eos ()
+{
+    BL_PROFILE("Castro::validate_eos()");
+
+    // variableSetUp runs again for every ensemble member and calibration
+    // trial, but the sweep only needs to be done once.
+
+    static bool validated = false;
+
+    if (validated) return;
+
+    validated = true;
+
+#ifdef AMREX_USE_CUDA
+    amrex::Print() << "The EOS validation is not available in GPU builds." << std::endl << std::endl;
+#else
+    // The sweep covers the table with npts densities and temperatures; the
+    // errors are the maximum relative differences from the reference EOS.
+    const int npts = 200;
+
+    const std::vector<std::string> names = {"pressure", "energy", "entropy", "sound speed",
+                                            "gamma_1", "temperature (rho, e)"};
+
+    Real max_err[6];
+    Real ref_time, fast_time;
+
+    eos_validate_fast_math(npts, max_err, &ref_time, &fast_time);
+
+    amrex::Print() << "EOS fast math validation over " << npts * npts << " points of the table:" << std::endl << std::endl;
+
+    for (int n = 0; n < 6; ++n)
+        amrex::Print() << std::setw(24) << std::left << names[n] << std::right
+                       << std::scientific << std::setprecision(3) << max_err[n] << std::endl;
+
+    amrex::Print() << std::endl << "Time for " << npts * npts << " (rho, e) inversions (s): "
+                   << std::fixed << std::setprecision(4) << ref_time << " reference, "
+                   << fast_time << " fast math";
+    if (fast_time > 0.0)
+        amrex::Print() << " (speedup " << std::setprecision(2) << ref_time / fast_time << ")";
+    amrex::Print() << std::endl << std::endl;
+#endif
+}
+
+MFItInfo
+Castro::tile_info ()
+{
+    // Dynamic scheduling would undo the placement done by first_touch,
+    // which relies on each tile always being computed by the same thread.
+
+    return MFItInfo().EnableTiling(tile_size).SetDynamic(dynamic_tiling && !numa_first_touch);
+}
+
+void
+Castro::first_touch (MultiFab& mf)
+{
+#if defined(__linux__) && !defined(AMREX_USE_GPU)
+    BL_PROFILE("Castro::first_touch()");
+
+    // Transparent huge pages must be requested before the memory is touched.
+
+    if (huge_pages) {
+
+        const std::uintptr_t page_size = sysconf(_SC_PAGESIZE);
+
+        for (MFIter mfi(mf); mfi.isValid(); ++mfi) {
+
+            FArrayBox& fab = mf[mfi];
+
+            const std::uintptr_t lo = reinterpret_cast<std::uintptr_t>(fab.dataPtr()) & ~(page_size - 1);
+            const std::uintptr_t hi = reinterpret_cast<std::uintptr_t>(fab.dataPtr()) + fab.nBytes();
+
+            madvise(reinterpret_cast<void*>(lo), hi - lo, MADV_HUGEPAGE);
+
+        }
+
+    }
+
+    // Write every tile from the thread that owns it in the compute loops,
+    // so that the pages are placed on that thread's NUMA node.
+
+    if (numa_first_touch) {
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+        for (MFIter mfi(mf, tile_info()); mfi.isValid(); ++mfi) {
+            const Box& box = mfi.growntilebox();
+            mf[mfi].setVal(0.0, box, 0, mf.nComp());
+        }
+
+    }
+#endif
+}
+
+Real
+Castro::thread_region_start ()
+{
+    if (!thread_timing) return 0.0;
+
+#ifdef AMREX_USE_OMP
+    const int nthreads = omp_get_max_threads();
+#else
+    const int nthreads = 1;
+#endif
+
+    if (static_cast<int>(thread_busy_time.size()) != nthreads) {
+        thread_busy_time.resize(nthreads, 0.0);
+        thread_wait_time.resize(nthreads, 0.0);
+        thread_done_time.resize(nthreads);
+    }
+
+    // A negative done time marks a thread that has not taken part in
+    // this region (the team may be smaller than the maximum).
+
+    for (Real& t : thread_done_time)
+        t = -1.0;
+
+    return ParallelDescriptor::second();
+}
+
+void
+Castro::thread_loop_done (Real region_start)
+{
+    if (!thread_timing) return;
+
+#ifdef AMREX_USE_OMP
+    const int tid = omp_get_thread_num();
+#else
+    const int tid = 0;
+#endif
+
+    const Real now = ParallelDescriptor::second();
+
+    thread_busy_time[tid] += now - region_start;
+    thread_done_time[tid] = now;
+}
+
+void
+Castro::thread_region_done ()
+{
+    if (!thread_timing) return;
+
+    // Every thread waits at the end of the parallel region
+    // until the last one has finished its tiles.
+
+    const Real now = ParallelDescriptor::second();
+
+    for (int tid = 0; tid < static_cast<int>(thread_wait_time.size()); ++tid)
+        if (thread_done_time[tid] >= 0.0)
+            thread_wait_time[tid] += now - thread_done_time[tid];
+}
+
+void
+Castro::print_thread_timing ()
+{
+    const int nthreads = thread_busy_time.size();
+
+    if (nthreads == 0) return;
+
+    // Average over the MPI ranks.
+
+    Vector<Real> busy = thread_busy_time;
+    Vector<Real> wait = thread_wait_time;
+
+    ParallelDescriptor::ReduceRealSum(busy.dataPtr(), nthreads);
+    ParallelDescriptor::ReduceRealSum(wait.dataPtr(), nthreads);
+
+    const Real nprocs = ParallelDescriptor::NProcs();
+
+    amrex::Print() << "Tile loop time per thread (s), averaged over MPI ranks" << std::endl;
+    amrex::Print() << "(hydro, state cleaning and timestep loops; " << (dynamic_tiling ? "dynamic" : "static")
+                   << " tile scheduling):" << std::endl << std::endl;
+
+    amrex::Print() << std::setw(8) << "thread" << std::setw(14) << "busy" << std::setw(14) << "wait"
+                   << std::setw(10) << "wait %" << std::endl;
+
+    Real max_busy = 0.0;
+    Real sum_busy = 0.0;
+
+    for (int tid = 0; tid < nthreads; ++tid) {
+
+        const Real b = busy[tid] / nprocs;
+        const Real w = wait[tid] / nprocs;
+
+        max_busy = std::max(max_busy, b);
+        sum_busy += b;
+
+        amrex::Print() << std::setw(8) << tid
+                       << std::setw(14) << std::fixed << std::setprecision(4) << b
+                       << std::setw(14) << w
+                       << std::setw(10) << std::setprecision(1) << (b + w > 0.0 ? 100.0 * w / (b + w) : 0.0)
+                       << std::endl;
+
+    }
+
+    // The load imbalance is the ratio of the slowest thread to the average.
+
+    if (sum_busy > 0.0)
+        amrex::Print() << std::endl << "Load imbalance (max / mean busy time): "
+                       << std::setprecision(3) << max_busy / (sum_busy / nthreads) << std::endl;
+
+    amrex::Print() << std::endl;
+}
+
+void
+Castro::errorEst (TagBoxArray& tags,
+                  int          clearval,
+                  int          tagval,
+                  Real         time,
+                  int          n_error_buf,
+                  int          ngrow)
+{
+    BL_PROFILE("Castro::errorEst()");
+
+    // Tag on a copy of the density with one ghost zone, so that the
+    // gradient is centred at the edges of the grids as well. The state
+    // has no ghost zones, so it can't be tagged in place.
+
+    MultiFab& den = tagging_density(time);
+
+    const int8_t set   = (int8_t) TagBox::SET;
+    const int8_t clear = (int8_t) TagBox::CLEAR;
+    
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+    for (MFIter mfi(den, tile_size); mfi.isValid(); ++mfi)
+    {
+        const Box& box = mfi.tilebox();
+        auto tags_arr = tags[mfi].array();
+        auto data_arr = den[mfi].array();
+
+        CASTRO_LAUNCH_LAMBDA("denerror", box, lbx,
+        {
+            denerror(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                     (int8_t*) AMREX_ARR4_TO_FORTRAN_ANYD(tags_arr),
+                     AMREX_ARR4_TO_FORTRAN_ANYD(data_arr),
+                     set, clear);
+        });
+    }
+
+    tag_density.reset();
+}
+
+MultiFab&
+Castro::tagging_density (Real time)
+{
+    BL_PROFILE("Castro::tagging_density()");
+
+    // Reuse the copy made by okToRegrid for the regrid that follows it,
+    // so that each regrid check fills the density only once.
+
+    const Real eps = 1.e-12 * std::max(1.0, std::abs(time));
+
+    if (!tag_density || std::abs(time - tag_density_time) > eps) {
+
+        const Real strt = ParallelDescriptor::second();
+
+        tag_density.reset(new MultiFab(grids, dmap, 1, 1));
+        FillPatch(*this, *tag_density, 1, time, State_Type, Density, 1);
+
+        tag_density_time = time;
+
+        num_tag_fills++;
+        tag_fill_time += ParallelDescriptor::second() - strt;
+
+    }
+
+    return *tag_density;
+}
+
+// Given State_Type state data, perform a number of cleaning steps to make
+// sure the data is sensible. The composition (abar, zbar) of the cleaned
+// state is stored in comp, which must have at least as many ghost zones.
+
+void
+Castro::clean_state(MultiFab& state, MultiFab& comp)
+{
+    BL_PROFILE("Castro::clean_state()");
+    CASTRO_TRACE_REGION("clean_state");
+
+    int ng = state.nGrow();
+
+    BL_ASSERT(comp.nGrow() >= ng);
+
+    const Real region_start = thread_region_start();
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+    {
+    for (MFIter mfi(state, tile_info()); mfi.isValid(); ++mfi)
+    {
+        const Box& box = mfi.growntilebox(ng);
+        auto state_arr = state[mfi].array();
+        auto comp_arr = comp[mfi].array();
+
+        if (aos_eos) {
+
+            // Do all of the cleaning on a zone-interleaved copy of the state.
+
+            FArrayBox state_aos_fab(box, NUM_STATE);
+            Elixir elix_state_aos = state_aos_fab.elixir();
+            auto state_aos = state_aos_fab.array();
+
+            CASTRO_LAUNCH_LAMBDA("state_to_aos", box, lbx,
+            {
+                state_to_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                             AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
+                             AMREX_ARR4_TO_FORTRAN_ANYD(state_aos));
+            });
+
+            CASTRO_LAUNCH_LAMBDA("clean_state_aos", box, lbx,
+            {
+                clean_state_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                                AMREX_ARR4_TO_FORTRAN_ANYD(state_aos),
+                                AMREX_ARR4_TO_FORTRAN_ANYD(comp_arr));
+            });
+
+            CASTRO_LAUNCH_LAMBDA("state_from_aos", box, lbx,
+            {
+                state_from_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                               AMREX_ARR4_TO_FORTRAN_ANYD(state_aos),
+                               AMREX_ARR4_TO_FORTRAN_ANYD(state_arr));
+            });
+
+            continue;
+
+        }
+
+        // Ensure the density is larger than the density floor.
+
+        CASTRO_LAUNCH_LAMBDA("enforce_minimum_density", box, lbx,
+        {
+            enforce_minimum_density(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                                    AMREX_ARR4_TO_FORTRAN_ANYD(state_arr));
+        });
+
+        // Ensure all species are normalized, and compute the composition
+        // that the remaining steps use.
+
+        CASTRO_LAUNCH_LAMBDA("normalize_species", box, lbx,
+        {
+            normalize_species(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                              AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
+                              AMREX_ARR4_TO_FORTRAN_ANYD(comp_arr));
+        });
+
+        // Ensure (rho e) isn't too small or negative
+
+        CASTRO_LAUNCH_LAMBDA("reset_internal_e", box, lbx,
+        {
+            reset_internal_e(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                             AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
+                             AMREX_ARR4_TO_FORTRAN_ANYD(comp_arr));
+        });
+
+        // Make the temperature be consistent with the internal energy.
+
+        CASTRO_LAUNCH_LAMBDA("compute_temp", box, lbx,
+        {
+            compute_temp(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                         AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
+                         AMREX_ARR4_TO_FORTRAN_ANYD(comp_arr));
+        });
+    }
+
+    thread_loop_done(region_start);
+    }
+
+    thread_region_done();
+}
+
+void
+Castro::update_composition()
+{
+    BL_PROFILE("Castro::update_composition()");
+
+    const MultiFab& S_new = get_new_data(State_Type);
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+    for (MFIter mfi(composition, tile_size); mfi.isValid(); ++mfi)
+    {
+        const Box& box = mfi.tilebox();
+        auto state_arr = S_new[mfi].array();
+        auto comp_arr = composition[mfi].array();
+
+        CASTRO_LAUNCH_LAMBDA("compute_composition", box, lbx,
+        {
+            compute_composition(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                                AMREX_ARR4_TO_FORTRAN_ANYD(state_arr),
+                                AMREX_ARR4_TO_FORTRAN_ANYD(comp_arr));
+        });
+    }
+}
+
+void
+Castro::update_active_species ()
+{
+    BL_PROFILE("Castro::update_active_species()");
+
+    if (num_active_species == NumSpec) return;
+
+    // A species is negligible if its partial density is below this fraction
+    // of the maximum density everywhere. The species floor that clean_state
+    // applies is 1.e-30 of the local density, well below this.
+
+    const Real threshold = 1.e-20;
+
+    // Only the species that are not yet active need to be checked. The
+    // maximum density is stored in the last element.
+
+    const int nspec_check = NumSpec - num_active_species;
+
+    Vector<Real> max_val(nspec_check + 1, 0.0);
+
+    for (int lev = 0; lev <= parent->finestLevel(); ++lev) {
+
+        MultiFab& S_new = getLevel(lev).get_new_data(State_Type);
+
+        for (int n = 0; n < nspec_check; ++n)
+            max_val[n] = std::max(max_val[n], S_new.max(FirstSpec + num_active_species + n, 0, true));
+
+        max_val[nspec_check] = std::max(max_val[nspec_check], S_new.max(Density, 0, true));
+
+    }
+
+    ParallelDescriptor::ReduceRealMax(max_val.dataPtr(), nspec_check + 1);
+
+    int num_active = num_active_species;
+
+    for (int n = 0; n < nspec_check; ++n)
+        if (max_val[n] > threshold * max_val[nspec_check])
+            num_active = num_active_species + n + 1;
+
+    if (num_active != num_active_species) {
+
+        num_active_species = num_active;
+
+        set_active_species(num_active_species);
+
+        amrex::Print() << "Active species: " << num_active_species << " of " << NumSpec << std::endl;
+
+    }
+}
+
+Long
+Castro::ghost_zones (int ng) const
+{
+    BoxArray grown_grids(grids);
+    grown_grids.grow(ng);
+
+    return grown_grids.numPts() - grids.numPts();
+}
+
+Long
+Castro::coarse_fine_faces () const
+{
+    // This counts the faces between the grids too; the flux register
+    // holds data there until ClearInternalBorders is called in reflux.
+
+    Long nfaces = 0;
+
+    for (int i = 0; i < grids.size(); ++i) {
+        const IntVect len = amrex::coarsen(grids[i], crse_ratio).length();
+        nfaces += 2 * (static_cast<Long>(len[0]) * len[1] +
+                       static_cast<Long>(len[1]) * len[2] +
+                       static_cast<Long>(len[0]) * len[2]);
+    }
+
+    return nfaces;
+}
+
+void
+Castro::compute_exchange_volume ()
+{
+    // Every zone of one of our grids (or of its periodic images) that lies
+    // in the 4 ghost zones of a grid on another rank is sent to that rank.
+    // AMReX sends all of the data for one rank in a single message.
+
+    const int ng = 4;
+    const int myproc = ParallelDescriptor::MyProc();
+
+    const std::vector<IntVect> shifts = geom.periodicity().shiftIntVect();
+
+    exchange_send_zones = 0;
+
+    std::set<int> destinations;
+    std::vector<std::pair<int,Box>> isects;
+
+    for (int i = 0; i < grids.size(); ++i) {
+
+        if (dmap[i] != myproc) continue;
+
+        for (const IntVect& iv : shifts) {
+
+            Box bx = grids[i];
+            bx.shift(iv);
+
+            grids.intersections(bx, isects, false, ng);
+
+            for (const auto& is : isects) {
+                if (dmap[is.first] == myproc) continue;
+                exchange_send_zones += is.second.numPts();
+                destinations.insert(dmap[is.first]);
+            }
+
+        }
+
+    }
+
+    exchange_messages = destinations.size();
+}
+
+Real
+Castro::exchange_start ()
+{
+    if (!comm_stats) return 0.0;
+
+    Gpu::synchronize();
+
+    return ParallelDescriptor::second();
+}
+
+void
+Castro::exchange_done (Real start, int ncomp)
+{
+    if (!comm_stats) return;
+
+    Gpu::synchronize();
+
+    comm_step_time += ParallelDescriptor::second() - start;
+    comm_step_bytes += static_cast<Real>(exchange_send_zones) * ncomp * sizeof(Real);
+    comm_step_full_bytes += static_cast<Real>(exchange_send_zones) * NUM_STATE * sizeof(Real);
+    comm_step_messages += exchange_messages;
+}
+
+// Print the average and maximum over the ranks of the bytes, messages
+// and time of the ghost zone exchanges, given this rank's totals. The
+// bytes and messages come from compute_exchange_volume's count of the
+// ghost zones, not from the communication itself.
+
+static void
+print_comm_line (const std::string& label, Real bytes, Real full_bytes, Real messages, Real time)
+{
+    const int nprocs = ParallelDescriptor::NProcs();
+
+    Real sum[4] = {bytes, full_bytes, messages, time};
+    Real max[3] = {bytes, messages, time};
+
+    ParallelDescriptor::ReduceRealSum(sum, 4);
+    ParallelDescriptor::ReduceRealMax(max, 3);
+
+    amrex::Print() << label << std::fixed << std::setprecision(3)
+                   << sum[0] / nprocs / 1.0e6 << " MB in " << std::setprecision(1) << sum[2] / nprocs
+                   << " messages sent per rank, modeled (max " << std::setprecision(3) << max[0] / 1.0e6 << " MB in "
+                   << std::setprecision(0) << max[1] << "), " << std::setprecision(4) << sum[3] / nprocs
+                   << " s per rank (max " << max[2] << " s), " << std::setprecision(1)
+                   << (sum[1] > 0.0 ? 100.0 * sum[0] / sum[1] : 100.0) << "% of the full state" << std::endl;
+}
+
+void
+Castro::print_comm_step_stats (int step)
+{
+    print_comm_line("Ghost zone exchange in step " + std::to_string(step) + ": ",
+                    comm_step_bytes, comm_step_full_bytes, comm_step_messages, comm_step_time);
+
+    comm_bytes += comm_step_bytes;
+    comm_full_bytes += comm_step_full_bytes;
+    comm_messages += comm_step_messages;
+    comm_time += comm_step_time;
+    ++comm_steps;
+
+    comm_step_bytes = 0.0;
+    comm_step_full_bytes = 0.0;
+    comm_step_messages = 0.0;
+    comm_step_time = 0.0;
+}
+
+void
+Castro::print_comm_stats ()
+{
+    if (comm_steps == 0) return;
+
+    amrex::Print() << "Ghost zone exchange in the FillPatch. The bytes and messages are modeled, not measured:" << std::endl
+                   << "they count the ghost zones that lie in grids of the same level on other ranks, in one message" << std::endl
+                   << "per rank. The time is measured and includes the interpolation from the coarser level:" << std::endl;
+
+    print_comm_line("  Total over " + std::to_string(comm_steps) + " steps: ",
+                    comm_bytes, comm_full_bytes, comm_messages, comm_time);
+    print_comm_line("  Per step: ",
+                    comm_bytes / comm_steps, comm_full_bytes / comm_steps,
+                    comm_messages / comm_steps, comm_time / comm_steps);
+
+    amrex::Print() << std::endl;
+}
+
+// Names of the AMR phases, in the order of AmrPhase.
+
+static const char* amr_phase_names[NUM_AMR_PHASES] =
+    { "FillPatch", "hydro", "flux reg", "reflux", "avg down", "sync clean", "regrid" };
+
+Real
+Castro::amr_phase_start ()
+{
+    if (!amr_timing) return 0.0;
+
+    // Finish any outstanding GPU work so that it is not charged to this phase.
+
+    Gpu::synchronize();
+
+    return ParallelDescriptor::second();
+}
+
+void
+Castro::amr_phase_done (int lev, int phase, Real start, Long nzones)
+{
+    Gpu::synchronize();
+
+    const Real elapsed = ParallelDescriptor::second() - start;
+
+    const int n = (lev + 1) * NUM_AMR_PHASES;
+
+    if (static_cast<int>(amr_phase_time.size()) < n) {
+        amr_phase_time.resize(n, 0.0);
+        amr_phase_zones.resize(n, 0.0);
+        amr_step_time.resize(n, 0.0);
+        amr_step_zones.resize(n, 0.0);
+    }
+
+    const int i = lev * NUM_AMR_PHASES + phase;
+
+    amr_phase_time[i] += elapsed;
+    amr_step_time[i] += elapsed;
+
+    amr_phase_zones[i] += nzones;
+    amr_step_zones[i] += nzones;
+}
+
+// Print a table of the time (maximum over MPI ranks) and the data moved
+// (summed over ranks) for each level and phase.
+
+static void
+print_amr_phase_table (const Vector<Real>& phase_time, const Vector<Real>& phase_zones)
+{
+    const int n = phase_time.size();
+
+    if (n == 0) return;
+
+    Vector<Real> time = phase_time;
+    Vector<Real> zones = phase_zones;
+
+    ParallelDescriptor::ReduceRealMax(time.dataPtr(), n);
+    ParallelDescriptor::ReduceRealSum(zones.dataPtr(), n);
+
+    // Each zone or face moves NUM_STATE reals.
+
+    const Real mb_per_zone = NUM_STATE * sizeof(Real) / (1024.0 * 1024.0);
+
+    amrex::Print() << std::setw(7) << "level" << std::setw(12) << "phase"
+                   << std::setw(12) << "time (s)" << std::setw(14) << "data (MB)" << std::endl;
+
+    for (int lev = 0; lev < n / NUM_AMR_PHASES; ++lev) {
+
+        Real hydro_time = 0.0;
+        Real overhead_time = 0.0;
+
+        for (int phase = 0; phase < NUM_AMR_PHASES; ++phase) {
+
+            const int i = lev * NUM_AMR_PHASES + phase;
+
+            if (phase == Hydro_Phase)
+                hydro_time += time[i];
+            else
+                overhead_time += time[i];
+
+            amrex::Print() << std::setw(7) << lev << std::setw(12) << amr_phase_names[phase]
+                           << std::setw(12) << std::fixed << std::setprecision(4) << time[i]
+                           << std::setw(14) << std::setprecision(2) << zones[i] * mb_per_zone << std::endl;
+
+        }
+
+        if (hydro_time + overhead_time > 0.0)
+            amrex::Print() << std::setw(7) << lev << std::setw(12) << "overhead %"
+                           << std::setw(12) << std::setprecision(1)
+                           << 100.0 * overhead_time / (hydro_time + overhead_time) << std::endl;
+
+    }
+
+    amrex::Print() << std::endl;
+}
+
+void
+Castro::print_amr_step_timing (int step)
+{
+    amrex::Print() << "AMR phase breakdown of coarse step " << step << ":" << std::endl;
+
+    print_amr_phase_table(amr_step_time, amr_step_zones);
+
+    for (Real& t : amr_step_time) t = 0.0;
+    for (Real& z : amr_step_zones) z = 0.0;
+}
+
+void
+Castro::print_amr_timing (Real runtime)
+{
+    amrex::Print() << "AMR phase breakdown of the run (" << std::fixed << std::setprecision(3)
+                   << runtime << " s in total):" << std::endl;
+
+    print_amr_phase_table(amr_phase_time, amr_phase_zones);
+}
+
+void
+Castro::startup_phase_done (int phase, Real start)
+{
+    Gpu::synchronize();
+
+    startup_phase_time[phase] += ParallelDescriptor::second() - start;
+}
+
+void
+Castro::print_startup_timing (Real startup_time)
+{
+    Real times[NUM_STARTUP_PHASES + 1];
+
+    for (int n = 0; n < NUM_STARTUP_PHASES; ++n)
+        times[n] = startup_phase_time[n];
+    times[NUM_STARTUP_PHASES] = startup_time;
+
+    ParallelDescriptor::ReduceRealMax(times, NUM_STARTUP_PHASES + 1, ParallelDescriptor::IOProcessorNumber());
+
+    // Everything else in the startup is the creation of the grids (and
+    // the tagging for refinement).
+
+    Real grid_time = times[NUM_STARTUP_PHASES];
+    for (int n = 0; n < NUM_STARTUP_PHASES; ++n)
+        grid_time -= times[n];
+    grid_time = std::max(grid_time, static_cast<Real>(0.0));
+
+    amrex::Print() << std::fixed << std::setprecision(3)
+                   << "Startup time (s): " << times[NUM_STARTUP_PHASES]
+                   << " (EOS table load " << times[TableLoad_Startup]
+                   << ", grid creation " << grid_time
+                   << ", initial data " << times[InitData_Startup]
+                   << ", average down " << times[PostInit_Startup]
+                   << ", first dt " << times[FirstDt_Startup] << ")" << std::endl << std::endl;
+}
+
+void
+Castro::reset_statistics ()
+{
+    num_zones_advanced = 0.0;
+    num_zones_equivalent = 0.0;
+
+    num_regrids = 0;
+    regrid_time = 0.0;
+    num_tag_fills = 0;
+    tag_fill_time = 0.0;
+    regrid_start_time = -1.0;
+
+    eos_reset_iteration_histogram();
+
+    eos_last_calls = 0.0;
+    eos_last_iters = 0.0;
+
+    thread_busy_time.clear();
+    thread_wait_time.clear();
+    thread_done_time.clear();
+
+    amr_phase_time.clear();
+    amr_phase_zones.clear();
+    amr_step_time.clear();
+    amr_step_zones.clear();
+
+    comm_step_bytes = 0.0;
+    comm_step_full_bytes = 0.0;
+    comm_step_messages = 0.0;
+    comm_step_time = 0.0;
+    comm_bytes = 0.0;
+    comm_full_bytes = 0.0;
+    comm_messages = 0.0;
+    comm_time = 0.0;
+    comm_steps = 0;
+
+    for (Real& t : startup_phase_time) t = 0.0;
 }
@@ -26,75 +26,273 @@ Castro::advance (Real time, Real dt, int  amr_iteration, int  amr_ncycle)
 
 {
     BL_PROFILE("Castro::advance()");
+    CASTRO_TRACE_REGION("advance");
 
     // Swap the new data from the last timestep into the old state data.
 
-    state[0].allocOldData();
+    if (!state[0].hasOldData()) {
+        state[0].allocOldData();
+        first_touch(get_old_data(State_Type));
+    }
+
     state[0].swapTimeLevels(dt);
 
-    // Allocate space for the MultiFabs we need during the step.
+    // Allocate space for the MultiFabs we need during the step. With
+    // numa_first_touch or huge_pages these are kept from step to step
+    // (until the next regrid), since freshly allocated memory is usually
+    // recycled from the arena and would not be placed again anyway; they
+    // are first touched once, when they are allocated.
+
+    const bool keep_temporaries = numa_first_touch || huge_pages;
+
+    if (!hydro_source.isDefined()) {
+
+        hydro_source.define(grids,dmap,NUM_STATE,0);
+        Sborder.define(grids, dmap, NUM_STATE, 4);
+        Sborder_comp.define(grids, dmap, NUM_COMP, 4);
+
+        if (keep_temporaries) {
+            first_touch(hydro_source);
+            first_touch(Sborder);
+            first_touch(Sborder_comp);
+        }
+
+    }
+
+    // We only need to store the fluxes for the whole level if there is
+    // a finer level, whose flux register is initialized from them by
+    // CrseInit. On a fine level the fluxes on the grid boundaries are
+    // added straight into this level's flux register by the hydro
+    // update. Every face is overwritten by the hydro update, so there's
+    // no need to zero them out.
+
+    const bool store_fluxes = level < parent->finestLevel();
+
+    for (int dir = 0; dir < 3; ++dir) {
+        if (store_fluxes) {
+            if (!fluxes[dir]) {
+                fluxes[dir].reset(new MultiFab(getEdgeBoxArray(dir), dmap, NUM_STATE, 0));
+                first_touch(*fluxes[dir]);
+            }
+        }
+        else {
+            fluxes[dir].reset();
+        }
+    }
 
-    hydro_source.define(grids,dmap,NUM_STATE,0);
-    Sborder.define(grids, dmap, NUM_STATE, 4);
+    MultiFab& S_old = get_old_data(State_Type);
+    MultiFab& S_new = get_new_data(State_Type);
 
-    // Zero out the current fluxes.
+    // At the start of each coarse step, check whether any more species
+    // need to be carried through the hydro update. Only the state
+    // components up to the last active species are filled, updated and
+    // refluxed.
 
-    for (int dir = 0; dir < 3; ++dir)
-	fluxes[dir]->setVal(0.0);
+    if (level == 0 && active_species)
+        update_active_species();
 
-    MultiFab& S_old = get_old_data(State_Type);
-    MultiFab& S_new = get_new_data(State_Type);
+    const int ncomp = FirstSpec + num_active_species;
 
     // Clean the old-time state, in case we came in after a regrid
     // where the state could be thermodynamically inconsistent.
 
-    clean_state(S_old);
+    clean_state(S_old, composition);
 
     // Initialize the new-time data from the old time data.
 
-    MultiFab::Copy(S_new, S_old, 0, 0, NUM_STATE, S_new.nGrow());
+    if (eos_temp_extrapolation && prev_dt > 0.0) {
 
-    // For the hydrodynamics update we need to have NUM_GROW ghost
-    // zones available, but the state data does not carry ghost
-    // zones. So we use a FillPatch using the state data to give us
-    // Sborder, which does have ghost zones.
+        // After the swap the new-time data still holds the state of the
+        // previous step, so the temperature (the last component) can be
+        // extrapolated in place to give the EOS a better initial guess
+        // when the updated state is cleaned.
 
-    AmrLevel::FillPatch(*this, Sborder, 4, time, State_Type, 0, NUM_STATE);
+        static_assert(Temp == NUM_STATE - 1, "The temperature must be the last state component");
 
-    // Make the temporarily expanded state thermodynamically consistent after the fill.
+        MultiFab::Copy(S_new, S_old, 0, 0, Temp, S_new.nGrow());
+
+        const Real ratio = dt / prev_dt;
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+        for (MFIter mfi(S_new, tile_info()); mfi.isValid(); ++mfi) {
+
+            const Box& box = mfi.growntilebox();
+
+            auto old_arr = S_old[mfi].array();
+            auto new_arr = S_new[mfi].array();
+
+            CASTRO_LAUNCH_LAMBDA("extrapolate_temp", box, lbx,
+            {
+                extrapolate_temp(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                                 AMREX_ARR4_TO_FORTRAN_ANYD(old_arr),
+                                 AMREX_ARR4_TO_FORTRAN_ANYD(new_arr),
+                                 ratio);
+            });
+
+        }
+
+    }
+    else {
+
+        MultiFab::Copy(S_new, S_old, 0, 0, NUM_STATE, S_new.nGrow());
+
+    }
+
+    // Fill Sborder, with ghost zones, from the old-time state.
+
+    fill_sborder(S_old, time, ncomp);
+
+    if (do_ctu) {
+
+        // Construct the hydro source.
+
+        const Real hydro_start = amr_phase_start();
+
+        construct_hydro_source(dt);
+
+        if (amr_timing)
+            amr_phase_done(level, Hydro_Phase, hydro_start, 0);
+
+        // Add it to the state, scaled by the timestep.
+
+        MultiFab::Saxpy(S_new, dt, hydro_source, 0, 0, ncomp, 0);
+
+        // Make the state thermodynamically consistent.
+
+        clean_state(S_new, composition);
+
+    }
+    else {
+
+        // The method-of-lines update with the second-order strong
+        // stability preserving Runge-Kutta scheme: the first stage takes
+        // a forward Euler step, S^(1) = S^n + dt L(S^n), and the second
+        // gives S^{n+1} = S^n + dt/2 (L(S^n) + L(S^(1))).
+
+        Real hydro_start = amr_phase_start();
 
-    clean_state(Sborder);
+        construct_mol_hydro_source(dt, 0);
 
-    // Construct the hydro source.
+        if (amr_timing)
+            amr_phase_done(level, Hydro_Phase, hydro_start, 0);
 
-    construct_hydro_source(dt);
+        MultiFab::Saxpy(S_new, dt, hydro_source, 0, 0, ncomp, 0);
 
-    // Add it to the state, scaled by the timestep.
+        clean_state(S_new, composition);
 
-    MultiFab::Saxpy(S_new, dt, hydro_source, 0, 0, NUM_STATE, 0);
+        // The second stage is evaluated with the first stage state at the
+        // end of the step.
 
-    // Make the state thermodynamically consistent.
+        fill_sborder(S_new, time + dt, ncomp);
 
-    clean_state(S_new);
+        hydro_start = amr_phase_start();
+
+        construct_mol_hydro_source(dt, 1);
+
+        if (amr_timing)
+            amr_phase_done(level, Hydro_Phase, hydro_start, 0);
+
+        // hydro_source now holds the sum of the two stages. The
+        // temperature of the first stage is kept as the EOS guess.
+
+        MultiFab::Copy(S_new, S_old, 0, 0, ncomp, 0);
+        MultiFab::Saxpy(S_new, 0.5 * dt, hydro_source, 0, 0, ncomp, 0);
+
+        clean_state(S_new, composition);
+
+    }
 
     // Update the flux registers.
 
+    const Real flux_reg_start = amr_phase_start();
+
     if (level < parent->finestLevel())
         for (int i = 0; i < 3; ++i)
-            getLevel(level+1).flux_reg.CrseInit(*fluxes[i], i, 0, 0, NUM_STATE, -1.0);
+            getLevel(level+1).flux_reg.CrseInit(*fluxes[i], i, 0, 0, ncomp, -1.0);
 
-    if (level > 0)
-        for (int i = 0; i < 3; ++i)
-            flux_reg.FineAdd(*fluxes[i], i, 0, 0, NUM_STATE, 1.0);
+    if (amr_timing && store_fluxes)
+        amr_phase_done(level, FluxReg_Phase, flux_reg_start, getLevel(level+1).coarse_fine_faces());
 
-    // Clear our temporary MultiFabs.
+    // Clear our temporary MultiFabs, unless we are keeping them.
 
-    hydro_source.clear();
-    Sborder.clear();
+    if (!keep_temporaries) {
+        hydro_source.clear();
+        Sborder.clear();
+        Sborder_comp.clear();
+    }
+
+    prev_dt = dt;
 
     // Record how many zones we have advanced.
 
     num_zones_advanced += grids.numPts() / getLevel(0).grids.numPts();
 
+    // A uniform grid at the finest resolution would advance the whole
+    // domain on every finest-level step.
+
+    if (level == parent->finestLevel())
+        num_zones_equivalent += static_cast<Real>(geom.Domain().numPts()) / getLevel(0).grids.numPts();
+
     return dt;
 }
+
+void
+Castro::fill_sborder (MultiFab& S, Real time, int ncomp)
+{
+    BL_PROFILE("Castro::fill_sborder()");
+
+    // For the hydrodynamics update we need to have NUM_GROW ghost
+    // zones available, but the state data does not carry ghost
+    // zones. So we use a FillPatch using the state data to give us
+    // Sborder, which does have ghost zones. The components are all
+    // exchanged in one FillPatch, so there is one message for each
+    // neighboring rank. The temperature is left out, since
+    // clean_state recomputes it from the internal energy.
+
+    const Real fillpatch_start = amr_phase_start();
+    const Real exchange_start_time = exchange_start();
+
+    {
+        CASTRO_TRACE_REGION("FillPatch");
+        AmrLevel::FillPatch(*this, Sborder, 4, time, State_Type, 0, ncomp);
+    }
+
+    exchange_done(exchange_start_time, ncomp);
+
+    // The inactive species are set to the floor by clean_state.
+
+    if (ncomp < FirstSpec + NumSpec)
+        Sborder.setVal(0.0, ncomp, FirstSpec + NumSpec - ncomp, Sborder.nGrow());
+
+    // The temperature is only the initial guess for the EOS. In the
+    // ghost zones, take it from the nearest valid zone of the same box.
+
+    MultiFab::Copy(Sborder, S, Temp, Temp, 1, 0);
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+    for (MFIter mfi(Sborder, tile_size); mfi.isValid(); ++mfi)
+    {
+        const Box& box = mfi.growntilebox(Sborder.nGrow());
+        const Box& valid = mfi.validbox();
+
+        auto sborder_arr = Sborder[mfi].array();
+
+        CASTRO_LAUNCH_LAMBDA("fill_temp_guess", box, lbx,
+        {
+            fill_temp_guess(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(sborder_arr),
+                            AMREX_ARLIM_ANYD(valid.loVect()), AMREX_ARLIM_ANYD(valid.hiVect()));
+        });
+    }
+
+    if (amr_timing)
+        amr_phase_done(level, FillPatch_Phase, fillpatch_start, ghost_zones(4));
+
+    // Make the temporarily expanded state thermodynamically consistent after the fill.
+
+    clean_state(Sborder, Sborder_comp);
+}
@@ -0,0 +1,334 @@
+#include <Castro.H>
+#include <Castro_F.H>
+
+#include <AMReX_Amr.H>
+#include <AMReX_ParmParse.H>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#ifdef AMREX_USE_CUDA
+#include <cuda_runtime.h>
+#endif
+
+#ifdef AMREX_USE_OMP
+#include <omp.h>
+#endif
+
+#ifdef AMREX_USE_MPI
+#include <mpi.h>
+#endif
+
+#if defined(__linux__) && !defined(AMREX_USE_GPU)
+#include <unistd.h>
+#endif
+
+using namespace amrex;
+
+namespace {
+
+// One candidate decomposition of the coarse level into max_box_size^3 boxes.
+
+struct Decomposition
+{
+    int max_box_size;
+    int min_box_size;
+    int boxes_per_rank;
+    Real ghost_overhead;
+    Real efficiency;
+    Real memory;
+    Real fom;
+};
+
+Real cube (Real n) { return n * n * n; }
+
+// Relative costs per zone in the model, in units of a zone of the hydro
+// update. The halo of each tile is recomputed by the hydro: the conversion
+// to primitive variables (roughly a sixth of the hydro) covers the tile
+// grown by NUM_GROW = 4 zones, and the rest the tile grown by one zone.
+// Every zone of Sborder is cleaned after the FillPatch, and the ghost
+// zones are also copied, through MPI when there is more than one rank.
+// On GPUs every box costs a fixed number of kernel launches, which is
+// worth about this many zones of work.
+
+constexpr Real ctoprim_fraction = 0.15;
+constexpr Real clean_cost = 0.1;
+constexpr Real ghost_copy_cost = 0.1;
+constexpr Real ghost_mpi_cost = 0.3;
+constexpr Real gpu_box_cost = 1.0e5;
+
+// The memory available to each rank, in bytes, or zero if it is unknown.
+
+Real rank_memory_limit ()
+{
+    Real limit = 0.0;
+
+    ParmParse pp;
+    if (pp.query("max_rank_memory", limit))
+        return limit * 1.0e9;
+
+#if defined(AMREX_USE_CUDA)
+    std::size_t free_mem, total_mem;
+    if (cudaMemGetInfo(&free_mem, &total_mem) == cudaSuccess)
+        limit = 0.9 * free_mem;
+#elif defined(__linux__)
+    int ranks_on_node = 1;
+#ifdef AMREX_USE_MPI
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(ParallelDescriptor::Communicator(), MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_size(node_comm, &ranks_on_node);
+    MPI_Comm_free(&node_comm);
+#endif
+    limit = 0.8 * static_cast<Real>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE) / ranks_on_node;
+#endif
+
+    return limit;
+}
+
+}
+
+void
+Castro::choose_decomposition (int n_cell, Real stop_time,
+                              int& max_box_size, int& min_box_size,
+                              bool fixed_min_box_size)
+{
+    BL_PROFILE("Castro::choose_decomposition()");
+
+    ParmParse pp;
+
+    int max_level = 0;
+    pp.query("max_level", max_level);
+
+    int aos = 0;
+    pp.query("aos_eos", aos);
+
+    int calibration_steps = 0;
+    pp.query("auto_box_calibration", calibration_steps);
+
+    const int nranks = ParallelDescriptor::NProcs();
+
+#if defined(AMREX_USE_OMP) && !defined(AMREX_USE_GPU)
+    const int nthreads = omp_get_max_threads();
+#else
+    const int nthreads = 1;
+#endif
+
+    const Real memory_limit = rank_memory_limit();
+
+    // The persistent state of each box: the old and new state and the
+    // composition, and during the advance the hydro source, Sborder
+    // (with NUM_GROW ghost zones) and, with a finer level, the fluxes.
+
+    const int ng = 4;
+
+    auto box_memory = [&] (Real b) -> Real
+    {
+        Real words = (3 * NUM_STATE + NUM_COMP) * cube(b) + (NUM_STATE + NUM_COMP) * cube(b + 2 * ng);
+        if (max_level > 0)
+            words += 3 * NUM_STATE * cube(b);
+        return sizeof(Real) * words;
+    };
+
+    // The hydro scratch space of each tile in flight (construct_hydro_source).
+
+    auto tile_memory = [&] (Real tx, Real ty, Real tz) -> Real
+    {
+        const Real qbx = (tx + 2 * ng) * (ty + 2 * ng) * (tz + 2 * ng);
+        const Real obx = (tx + 2) * (ty + 2) * (tz + 2);
+        Real bytes = sizeof(Real) * (QVAR + NQAUX + (aos ? NUM_STATE : 0)) * qbx;
+        bytes += sizeof(Real) * (2 + QVAR + 5 * NUM_STATE + 5 * NGDNV) * obx;
+        bytes += sizeof(castro_edge_real) * 20 * QVAR * obx;
+        return bytes;
+    };
+
+    // The candidates are the box sizes that divide n_cell evenly, in
+    // multiples of 8 zones (of min_box_size, if that is fixed).
+
+    const int step = fixed_min_box_size ? min_box_size : 8;
+
+    Vector<Decomposition> candidates;
+
+    for (int b = step; b <= n_cell; b += step)
+    {
+        if (n_cell % b != 0) continue;
+
+        Decomposition d;
+
+        d.max_box_size = b;
+
+        // Without a fixed min_box_size, use the largest power of two that
+        // divides the boxes, but at most 16 with refinement so that the
+        // fine grids can follow the features closely.
+
+        if (fixed_min_box_size) {
+            d.min_box_size = min_box_size;
+        } else {
+            d.min_box_size = 1;
+            while (b % (2 * d.min_box_size) == 0 && (max_level == 0 || d.min_box_size < 16))
+                d.min_box_size *= 2;
+        }
+
+        const Long nboxes = static_cast<Long>(n_cell / b) * (n_cell / b) * (n_cell / b);
+
+        d.boxes_per_rank = (nboxes + nranks - 1) / nranks;
+
+        // Tiles, as chosen by tile_size (one tile per box on GPUs).
+
+        const int tx = std::min(b, tile_size[0]);
+        const int ty = std::min(b, tile_size[1]);
+        const int tz = std::min(b, tile_size[2]);
+
+        const Long tiles_per_box = static_cast<Long>((b + tx - 1) / tx) * ((b + ty - 1) / ty) * ((b + tz - 1) / tz);
+
+        const Real tile_cost = ctoprim_fraction * (tx + 2 * ng) * (ty + 2 * ng) * (tz + 2 * ng) +
+                               (1.0 - ctoprim_fraction) * (tx + 2) * (ty + 2) * (tz + 2);
+
+        const Real ghost_cost = clean_cost * cube(b + 2 * ng) +
+                                (nranks > 1 ? ghost_mpi_cost : ghost_copy_cost) * (cube(b + 2 * ng) - cube(b));
+
+        d.ghost_overhead = (tiles_per_box * tile_cost + ghost_cost) / cube(b) - 1.0;
+
+        // The time of the busiest rank, in zones of hydro work per thread.
+        // The tiles of a rank are handed out to its threads in turn.
+
+#ifdef AMREX_USE_GPU
+        const Real rank_time = d.boxes_per_rank * (tiles_per_box * tile_cost + ghost_cost + gpu_box_cost);
+        const Real tiles_in_flight = 1;
+#else
+        const Long tiles_per_rank = d.boxes_per_rank * tiles_per_box;
+        const Real rank_time = ((tiles_per_rank + nthreads - 1) / nthreads) * tile_cost +
+                               d.boxes_per_rank * ghost_cost / nthreads;
+        const Real tiles_in_flight = std::min(static_cast<Long>(nthreads), tiles_per_rank);
+#endif
+
+        d.efficiency = cube(n_cell) / (static_cast<Real>(nranks) * nthreads * rank_time);
+
+        d.memory = d.boxes_per_rank * box_memory(b) + tiles_in_flight * tile_memory(tx, ty, tz);
+
+        d.fom = 0.0;
+
+        candidates.push_back(d);
+    }
+
+    if (candidates.empty()) {
+        amrex::Print() << "max_box_size = auto found no box size dividing n_cell = " << n_cell
+                       << " in multiples of " << step << "; using a single box." << std::endl << std::endl;
+        max_box_size = n_cell;
+        if (!fixed_min_box_size) min_box_size = n_cell;
+        return;
+    }
+
+    // Rank the candidates that fit in memory by their modeled efficiency,
+    // preferring larger boxes for equal efficiency.
+
+    auto fits = [&] (const Decomposition& d) { return memory_limit <= 0.0 || d.memory <= memory_limit; };
+
+    std::sort(candidates.begin(), candidates.end(),
+              [&] (const Decomposition& a, const Decomposition& b)
+              {
+                  if (fits(a) != fits(b)) return fits(a);
+                  if (!fits(a)) return a.memory < b.memory;
+                  if (a.efficiency != b.efficiency) return a.efficiency > b.efficiency;
+                  return a.max_box_size > b.max_box_size;
+              });
+
+    int best = 0;
+
+    // Optionally time a few coarse steps of the best candidates, each in a
+    // throwaway Amr hierarchy, and take the one with the highest throughput.
+
+    if (calibration_steps > 0 && fits(candidates[0]))
+    {
+        const int num_trials = std::min(3, static_cast<int>(candidates.size()));
+
+        amrex::Print() << "Calibrating max_box_size = auto with " << calibration_steps
+                       << " steps of the " << num_trials << " best modeled candidates..." << std::endl;
+
+        ParmParse pp_amr("amr");
+
+        Real best_fom = 0.0;
+
+        for (int n = 0; n < num_trials && fits(candidates[n]); ++n)
+        {
+            pp_amr.add("max_grid_size", candidates[n].max_box_size);
+            pp_amr.add("blocking_factor", candidates[n].min_box_size);
+
+            Amr* amrptr = new Amr;
+
+            amrptr->init(0.0, stop_time);
+
+            const Real start_zones = num_zones_advanced;
+            Real trial_time = ParallelDescriptor::second();
+
+            for (int s = 0; s < calibration_steps && amrptr->okToContinue(); ++s)
+                amrptr->coarseTimeStep(stop_time);
+
+            trial_time = ParallelDescriptor::second() - trial_time;
+            ParallelDescriptor::ReduceRealMax(trial_time);
+
+            const Real zones = (num_zones_advanced - start_zones) * amrptr->getLevel(0).boxArray().numPts();
+
+            delete amrptr;
+
+            candidates[n].fom = trial_time > 0.0 ? zones / trial_time / 1.e6 : 0.0;
+
+            if (candidates[n].fom > best_fom) {
+                best_fom = candidates[n].fom;
+                best = n;
+            }
+        }
+
+        reset_statistics();
+    }
+
+    amrex::Print() << "Automatic decomposition for " << nranks << " MPI rank(s) x " << nthreads
+                   << " thread(s), n_cell = " << n_cell << ":" << std::endl << std::endl;
+
+    amrex::Print() << std::setw(14) << "max_box_size" << std::setw(14) << "min_box_size"
+                   << std::setw(16) << "boxes per rank" << std::setw(16) << "ghost overhead"
+                   << std::setw(18) << "model efficiency" << std::setw(18) << "memory/rank (GB)";
+    if (calibration_steps > 0)
+        amrex::Print() << std::setw(16) << "zones / usec";
+    amrex::Print() << std::endl;
+
+    for (int n = 0; n < static_cast<int>(candidates.size()); ++n)
+    {
+        const Decomposition& d = candidates[n];
+
+        amrex::Print() << std::setw(14) << d.max_box_size << std::setw(14) << d.min_box_size
+                       << std::setw(16) << d.boxes_per_rank
+                       << std::fixed << std::setprecision(1) << std::setw(15) << 100.0 * d.ghost_overhead << "%"
+                       << std::setprecision(3) << std::setw(18) << d.efficiency
+                       << std::setw(18) << d.memory / 1.0e9;
+        if (calibration_steps > 0) {
+            if (d.fom > 0.0)
+                amrex::Print() << std::setw(16) << d.fom;
+            else
+                amrex::Print() << std::setw(16) << "-";
+        }
+        amrex::Print() << (n == best ? "  <--" : "") << std::endl;
+    }
+
+    amrex::Print() << std::endl;
+
+    const Decomposition& chosen = candidates[best];
+
+    max_box_size = chosen.max_box_size;
+    min_box_size = chosen.min_box_size;
+
+    amrex::Print() << "Chose max_box_size = " << max_box_size << " and min_box_size = " << min_box_size
+                   << ", with a predicted memory use of " << std::setprecision(3) << chosen.memory / 1.0e9
+                   << " GB per rank on the coarse level";
+    if (memory_limit > 0.0)
+        amrex::Print() << " (" << memory_limit / 1.0e9 << " GB available)";
+    amrex::Print() << "." << std::endl;
+
+    if (!fits(chosen))
+        amrex::Print() << "Warning: no decomposition is predicted to fit in the memory of a rank." << std::endl;
+
+    if (max_level > 0)
+        amrex::Print() << "The finer levels use the same max_box_size and min_box_size." << std::endl;
+
+    amrex::Print() << std::endl;
+}
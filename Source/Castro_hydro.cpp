@@ -8,27 +8,46 @@ Castro::construct_hydro_source(Real dt)
 {
 
   BL_PROFILE("Castro::construct_hydro_source()");
+  CASTRO_TRACE_REGION("construct_hydro_source");
 
   const Real strt_time = ParallelDescriptor::second();
 
   // this constructs the hydrodynamic source (essentially the flux
   // divergence) using the CTU framework for unsplit hydrodynamics
 
-  hydro_source.setVal(0.0);
+  // Only the components up to the last active species are computed.
+
+  hydro_source.setVal(0.0, 0, FirstSpec + num_active_species, 0);
 
   int finest_level = parent->finestLevel();
 
   auto dx = geom.CellSizeArray();
 
+  // Local copy of the Riemann solver choice for use in the kernel launches.
+  const int riemann = riemann_solver;
+  const int use_ppm = ppm_type;
+
+  // On a uniform Cartesian grid the face areas and cell volumes are
+  // constants, and we don't carry the area and volume MultiFabs.
+  const int cartesian = geom.IsCartesian();
+
+  // The fluxes are only stored for the whole level if a finer level
+  // needs them for CrseInit; a coarser level's flux register is filled
+  // tile by tile (see add_to_flux_register).
+  const int store_fluxes = fluxes[0] != nullptr;
+
   const int* domain_lo = geom.Domain().loVect();
   const int* domain_hi = geom.Domain().hiVect();
 
   MultiFab& S_new = get_new_data(State_Type);
 
+  const Real region_start = thread_region_start();
+
 #ifdef AMREX_USE_OMP
 #pragma omp parallel
 #endif
-  for (MFIter mfi(S_new, tile_size); mfi.isValid(); ++mfi) {
+  {
+  for (MFIter mfi(S_new, tile_info()); mfi.isValid(); ++mfi) {
 
       // the valid region box
       const Box& bx = mfi.tilebox();
@@ -38,10 +57,23 @@ Castro::construct_hydro_source(Real dt)
       const Box& qbx = amrex::grow(bx, 4);
 
       Array4<Real> const state = Sborder[mfi].array();
+      Array4<Real> const comp = Sborder_comp[mfi].array();
       Array4<Real> const source = hydro_source[mfi].array();
-      Array4<Real> const ar[3] = {area[0][mfi].array(), area[1][mfi].array(), area[2][mfi].array()};
-      Array4<Real> const fluxes_out[3] = {fluxes[0]->array(mfi), fluxes[1]->array(mfi), fluxes[2]->array(mfi)};
-      Array4<Real> const vol = volume[mfi].array();
+      Array4<Real> fluxes_out[3];
+
+      if (store_fluxes) {
+          for (int i = 0; i < 3; ++i)
+              fluxes_out[i] = fluxes[i]->array(mfi);
+      }
+
+      Array4<Real> ar[3];
+      Array4<Real> vol;
+
+      if (!cartesian) {
+          for (int i = 0; i < 3; ++i)
+              ar[i] = area[i][mfi].array();
+          vol = volume[mfi].array();
+      }
 
       amrex::Array<Box, 3> ebx;
       amrex::Array<Box, 3> gebx;
@@ -61,13 +93,41 @@ Castro::construct_hydro_source(Real dt)
 
       // Convert the conservative state to the primitive variable state.
 
-      CASTRO_LAUNCH_LAMBDA(qbx, lbx,
-      {
-          ctoprim(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                  AMREX_ARR4_TO_FORTRAN_ANYD(state),
-                  AMREX_ARR4_TO_FORTRAN_ANYD(q),
-                  AMREX_ARR4_TO_FORTRAN_ANYD(qaux));
-      });
+      if (aos_eos) {
+
+          FArrayBox state_aos_fab(qbx, NUM_STATE);
+          Elixir elix_state_aos = state_aos_fab.elixir();
+          Array4<Real> const state_aos = state_aos_fab.array();
+
+          CASTRO_LAUNCH_LAMBDA("state_to_aos", qbx, lbx,
+          {
+              state_to_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state_aos));
+          });
+
+          CASTRO_LAUNCH_LAMBDA("ctoprim_aos", qbx, lbx,
+          {
+              ctoprim_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(state_aos),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(comp),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(qaux));
+          });
+
+      }
+      else {
+
+          CASTRO_LAUNCH_LAMBDA("ctoprim", qbx, lbx,
+          {
+              ctoprim(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(comp),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(qaux));
+          });
+
+      }
 
       FArrayBox flux_fab[3], qe_fab[3];
 
@@ -101,16 +161,17 @@ Castro::construct_hydro_source(Real dt)
       tbx[2][2] = amrex::grow(ebx[2], IntVect(1,1,0));
       
       // The terms of qm and qp with i == j are the edge states that
-      // come out of the PPM edge state prediction. The terms with
-      // i /= j include transverse corrections.
+      // come out of the PPM (or PLM) edge state prediction. The terms with
+      // i /= j include transverse corrections. These (and ql, qr) are
+      // single precision in mixed-precision builds.
 
-      FArrayBox qm_fab[3][3], qp_fab[3][3];
+      BaseFab<castro_edge_real> qm_fab[3][3], qp_fab[3][3];
 
       Elixir elix_qm[3][3];
       Elixir elix_qp[3][3];
 
-      Array4<Real> qm[3][3];
-      Array4<Real> qp[3][3];
+      Array4<castro_edge_real> qm[3][3];
+      Array4<castro_edge_real> qp[3][3];
 
       for (int i = 0; i < 3; ++i) {
           for (int j = 0; j < 3; ++j) {
@@ -132,13 +193,19 @@ Castro::construct_hydro_source(Real dt)
       Elixir elix_div = div_fab.elixir();
       Array4<Real> const div = div_fab.array();
 
-      // Compute divu -- we'll use this later when doing the artificial viscosity
-      CASTRO_LAUNCH_LAMBDA(obx, lbx,
+      FArrayBox flat_fab(obx, 1);
+      Elixir elix_flat = flat_fab.elixir();
+      Array4<Real> const flat = flat_fab.array();
+
+      // Compute divu -- we'll use this later when doing the artificial viscosity --
+      // and the flattening coefficient, which is the same for all three tracing directions.
+      CASTRO_LAUNCH_LAMBDA("divu_flatten", obx, lbx,
       {
-          divu(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-               AMREX_ARR4_TO_FORTRAN_ANYD(q),
-               AMREX_ZFILL(dx.data()),
-               AMREX_ARR4_TO_FORTRAN_ANYD(div));
+          divu_flatten(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                       AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                       AMREX_ZFILL(dx.data()),
+                       AMREX_ARR4_TO_FORTRAN_ANYD(div),
+                       AMREX_ARR4_TO_FORTRAN_ANYD(flat));
       });
 
       FArrayBox q_int_fab(obx, QVAR);
@@ -161,13 +228,13 @@ Castro::construct_hydro_source(Real dt)
       Elixir elix_qgdnvtmp2 = qgdnvtmp2_fab.elixir();
       Array4<Real> const qgdnvtmp2 = qgdnvtmp2_fab.array();
 
-      FArrayBox ql_fab(obx, QVAR);
+      BaseFab<castro_edge_real> ql_fab(obx, QVAR);
       Elixir elix_ql = ql_fab.elixir();
-      Array4<Real> const ql = ql_fab.array();
+      Array4<castro_edge_real> const ql = ql_fab.array();
 
-      FArrayBox qr_fab(obx, QVAR);
+      BaseFab<castro_edge_real> qr_fab(obx, QVAR);
       Elixir elix_qr = qr_fab.elixir();
-      Array4<Real> const qr = qr_fab.array();
+      Array4<castro_edge_real> const qr = qr_fab.array();
 
       const amrex::Real hdtdx[3] = {0.5*dt/dx[0], 0.5*dt/dx[1], 0.5*dt/dx[2]};
       const amrex::Real cdtdx[3] = {dt/dx[0]/3.0, dt/dx[1]/3.0, dt/dx[2]/3.0};
@@ -176,18 +243,40 @@ Castro::construct_hydro_source(Real dt)
 
           idir_f = idir + 1;
 
-          CASTRO_LAUNCH_LAMBDA(obx, lbx,
-          {
-              trace_ppm(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                        AMREX_ARLIM_ANYD(bx.loVect()), AMREX_ARLIM_ANYD(bx.hiVect()),
-                        idir_f,
-                        AMREX_ARR4_TO_FORTRAN_ANYD(q),
-                        AMREX_ARR4_TO_FORTRAN_ANYD(qaux),
-                        AMREX_ARR4_TO_FORTRAN_ANYD(qm[idir][idir]),
-                        AMREX_ARR4_TO_FORTRAN_ANYD(qp[idir][idir]),
-                        AMREX_ARLIM_ANYD(domain_lo), AMREX_ARLIM_ANYD(domain_hi),
-                        AMREX_ZFILL(dx.data()), dt);
-          });
+          if (use_ppm) {
+
+              CASTRO_LAUNCH_LAMBDA("trace_ppm", obx, lbx,
+              {
+                  trace_ppm(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                            AMREX_ARLIM_ANYD(bx.loVect()), AMREX_ARLIM_ANYD(bx.hiVect()),
+                            idir_f,
+                            AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qaux),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(flat),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qm[idir][idir]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qp[idir][idir]),
+                            AMREX_ARLIM_ANYD(domain_lo), AMREX_ARLIM_ANYD(domain_hi),
+                            AMREX_ZFILL(dx.data()), dt);
+              });
+
+          }
+          else {
+
+              CASTRO_LAUNCH_LAMBDA("trace_plm", obx, lbx,
+              {
+                  trace_plm(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                            AMREX_ARLIM_ANYD(bx.loVect()), AMREX_ARLIM_ANYD(bx.hiVect()),
+                            idir_f,
+                            AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qaux),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(flat),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qm[idir][idir]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qp[idir][idir]),
+                            AMREX_ARLIM_ANYD(domain_lo), AMREX_ARLIM_ANYD(domain_hi),
+                            AMREX_ZFILL(dx.data()), dt);
+              });
+
+          }
 
       }
 
@@ -211,7 +300,7 @@ Castro::construct_hydro_source(Real dt)
           idir_t2_f = idir_t2 + 1;
 
           // Compute the flux in this coordinate direction
-          CASTRO_LAUNCH_LAMBDA(tbx[idir][idir], lbx,
+          CASTRO_LAUNCH_LAMBDA("compute_flux", tbx[idir][idir], lbx,
           {
               compute_flux(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qm[idir][idir]),
@@ -220,12 +309,17 @@ Castro::construct_hydro_source(Real dt)
                            AMREX_ARR4_TO_FORTRAN_ANYD(q_int),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qgdnvtmp1),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qaux),
-                           idir_f);
+                           AMREX_ARR4_TO_FORTRAN_ANYD(div),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(fluxes_out[idir]),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(ar[idir]),
+                           idir_f, riemann, AMREX_ZFILL(dx.data()),
+                           cartesian, 0, dt, 0);
           });
 
           // Update the states in one of the two orthogonal directions using the
           // transverse flux direction in this coordinate direction.
-          CASTRO_LAUNCH_LAMBDA(tbx[idir_t1][idir], lbx,
+          CASTRO_LAUNCH_LAMBDA("trans1", tbx[idir_t1][idir], lbx,
           {
               trans1(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                      idir_f, idir_t1_f,
@@ -240,7 +334,7 @@ Castro::construct_hydro_source(Real dt)
           });
 
           // Do the same for the other orthogonal direction.
-          CASTRO_LAUNCH_LAMBDA(tbx[idir_t2][idir], lbx,
+          CASTRO_LAUNCH_LAMBDA("trans1", tbx[idir_t2][idir], lbx,
           {
               trans1(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                      idir_f, idir_t2_f,
@@ -277,7 +371,7 @@ Castro::construct_hydro_source(Real dt)
 
           // Compute F^{1|2}, the flux in direction 1 given the transverse flux correction
           // from direction 2.
-          CASTRO_LAUNCH_LAMBDA(tbx[idir_t1][idir_t2], lbx,
+          CASTRO_LAUNCH_LAMBDA("compute_flux", tbx[idir_t1][idir_t2], lbx,
           {
               compute_flux(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qm[idir_t1][idir_t2]),
@@ -286,12 +380,17 @@ Castro::construct_hydro_source(Real dt)
                            AMREX_ARR4_TO_FORTRAN_ANYD(q_int),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qgdnvtmp1),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qaux),
-                           idir_t1_f);
+                           AMREX_ARR4_TO_FORTRAN_ANYD(div),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(fluxes_out[idir]),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(ar[idir]),
+                           idir_t1_f, riemann, AMREX_ZFILL(dx.data()),
+                           cartesian, 0, dt, 0);
           });
 
           // Compute F^{2|1}, the flux in direction 2 given the transverse flux correction
           // from direction 1.
-          CASTRO_LAUNCH_LAMBDA(tbx[idir_t2][idir_t1], lbx,
+          CASTRO_LAUNCH_LAMBDA("compute_flux", tbx[idir_t2][idir_t1], lbx,
           {                               
               compute_flux(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qm[idir_t2][idir_t1]),
@@ -300,11 +399,16 @@ Castro::construct_hydro_source(Real dt)
                            AMREX_ARR4_TO_FORTRAN_ANYD(q_int),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qgdnvtmp2),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qaux),
-                           idir_t2_f);
+                           AMREX_ARR4_TO_FORTRAN_ANYD(div),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(fluxes_out[idir]),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(ar[idir]),
+                           idir_t2_f, riemann, AMREX_ZFILL(dx.data()),
+                           cartesian, 0, dt, 0);
           });
 
           // Compute the corrected idir interface states, given the two transverse fluxes.
-          CASTRO_LAUNCH_LAMBDA(ebx[idir], lbx,
+          CASTRO_LAUNCH_LAMBDA("trans2", ebx[idir], lbx,
           {
               trans2(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                      idir_f, idir_t1_f, idir_t2_f,
@@ -321,7 +425,10 @@ Castro::construct_hydro_source(Real dt)
           });
 
           // Compute the final flux in direction idir, given the corrected interface states.
-          CASTRO_LAUNCH_LAMBDA(ebx[idir], lbx,
+          // The same pass applies the artificial viscosity, normalizes the species fluxes,
+          // and (if needed) stores the flux, scaled by dt * dA, for the flux register; we'll
+          // use it there for the coarse-fine level sync.
+          CASTRO_LAUNCH_LAMBDA("compute_flux", ebx[idir], lbx,
           {
               compute_flux(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                            AMREX_ARR4_TO_FORTRAN_ANYD(ql),
@@ -330,52 +437,284 @@ Castro::construct_hydro_source(Real dt)
                            AMREX_ARR4_TO_FORTRAN_ANYD(q_int),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qe[idir]),
                            AMREX_ARR4_TO_FORTRAN_ANYD(qaux),
-                           idir_f);
+                           AMREX_ARR4_TO_FORTRAN_ANYD(div),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(fluxes_out[idir]),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(ar[idir]),
+                           idir_f, riemann, AMREX_ZFILL(dx.data()),
+                           cartesian, store_fluxes, dt, 1);
           });
 
+          // On a fine level, add the flux on the grid boundary straight
+          // into the flux register.
+
+          if (level > 0)
+              add_to_flux_register(mfi, idir, ebx[idir], flux[idir], ar[idir], dt);
+
       }
 
-      for (int idir = 0; idir < AMREX_SPACEDIM; ++idir) {
+      // Construct the conservative update source term.
+
+      CASTRO_LAUNCH_LAMBDA("fill_hydro_source", bx, lbx,
+      {
+          fill_hydro_source(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(source),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(flux[0]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(flux[1]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(flux[2]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qe[0]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qe[1]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(qe[2]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(ar[0]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(ar[1]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(ar[2]),
+                            AMREX_ARR4_TO_FORTRAN_ANYD(vol),
+                            cartesian,
+                            AMREX_ZFILL(dx.data()), dt);
+      });
+
+  } // MFIter loop
+
+  thread_loop_done(region_start);
+  }
+
+  thread_region_done();
+
+}
+
+void
+Castro::construct_mol_hydro_source(Real dt, int stage)
+{
+
+  BL_PROFILE("Castro::construct_mol_hydro_source()");
+  CASTRO_TRACE_REGION("construct_mol_hydro_source");
 
-          int idir_f = idir + 1;
+  // this adds the hydrodynamic source (the flux divergence) of one
+  // stage of the method-of-lines update to hydro_source. Unlike CTU,
+  // the interface states are the edge values of the reconstruction
+  // with no characteristic tracing or transverse corrections, so each
+  // direction needs a single Riemann solve, but there are two stages
+  // per step.
 
-          // Apply artificial viscosity to the fluxes.
+  // Only the components up to the last active species are computed.
 
-          CASTRO_LAUNCH_LAMBDA(ebx[idir], lbx,
+  if (stage == 0)
+      hydro_source.setVal(0.0, 0, FirstSpec + num_active_species, 0);
+
+  auto dx = geom.CellSizeArray();
+
+  const int riemann = riemann_solver;
+  const int use_ppm = ppm_type;
+
+  const int cartesian = geom.IsCartesian();
+
+  // The fluxes for the flux register are the average of the fluxes of
+  // the two stages: each stage adds its flux, scaled by dt/2 * dA.
+
+  const int store_fluxes = fluxes[0] == nullptr ? 0 : (stage == 0 ? 1 : 2);
+
+  const Real stage_dt = 0.5 * dt;
+
+  MultiFab& S_new = get_new_data(State_Type);
+
+  const Real region_start = thread_region_start();
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+  {
+  for (MFIter mfi(S_new, tile_info()); mfi.isValid(); ++mfi) {
+
+      // the valid region box
+      const Box& bx = mfi.tilebox();
+
+      const Box& obx = amrex::grow(bx, 1);
+
+      const Box& qbx = amrex::grow(bx, 4);
+
+      Array4<Real> const state = Sborder[mfi].array();
+      Array4<Real> const comp = Sborder_comp[mfi].array();
+      Array4<Real> const source = hydro_source[mfi].array();
+      Array4<Real> fluxes_out[3];
+
+      if (store_fluxes) {
+          for (int i = 0; i < 3; ++i)
+              fluxes_out[i] = fluxes[i]->array(mfi);
+      }
+
+      Array4<Real> ar[3];
+      Array4<Real> vol;
+
+      if (!cartesian) {
+          for (int i = 0; i < 3; ++i)
+              ar[i] = area[i][mfi].array();
+          vol = volume[mfi].array();
+      }
+
+      // Declare local storage now.
+
+      FArrayBox q_fab(qbx, QVAR);
+      Elixir elix_q = q_fab.elixir();
+      Array4<Real> const q = q_fab.array();
+
+      FArrayBox qaux_fab(qbx, NQAUX);
+      Elixir elix_qaux = qaux_fab.elixir();
+      Array4<Real> const qaux = qaux_fab.array();
+
+      // Convert the conservative state to the primitive variable state.
+
+      if (aos_eos) {
+
+          FArrayBox state_aos_fab(qbx, NUM_STATE);
+          Elixir elix_state_aos = state_aos_fab.elixir();
+          Array4<Real> const state_aos = state_aos_fab.array();
+
+          CASTRO_LAUNCH_LAMBDA("state_to_aos", qbx, lbx,
           {
-              apply_av(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                       idir_f, AMREX_ZFILL(dx.data()),
-                       AMREX_ARR4_TO_FORTRAN_ANYD(div),
-                       AMREX_ARR4_TO_FORTRAN_ANYD(state),
-                       AMREX_ARR4_TO_FORTRAN_ANYD(flux[idir]));
+              state_to_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state_aos));
+          });
+
+          CASTRO_LAUNCH_LAMBDA("ctoprim_aos", qbx, lbx,
+          {
+              ctoprim_aos(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(state_aos),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(comp),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(qaux));
           });
 
-          // Ensure species fluxes are normalized properly.
+      }
+      else {
 
-          CASTRO_LAUNCH_LAMBDA(ebx[idir], lbx,
+          CASTRO_LAUNCH_LAMBDA("ctoprim", qbx, lbx,
           {
-              normalize_species_fluxes(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                                       AMREX_ARR4_TO_FORTRAN_ANYD(flux[idir]));
+              ctoprim(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(comp),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                      AMREX_ARR4_TO_FORTRAN_ANYD(qaux));
           });
 
-          // Store the fluxes from this advance; we'll use these in
-          // the flux register for doing the coarse-fine level sync.
-          // The flux is scaled by dt * dA.
+      }
+
+      FArrayBox div_fab(obx, 1);
+      Elixir elix_div = div_fab.elixir();
+      Array4<Real> const div = div_fab.array();
+
+      FArrayBox flat_fab(obx, 1);
+      Elixir elix_flat = flat_fab.elixir();
+      Array4<Real> const flat = flat_fab.array();
+
+      CASTRO_LAUNCH_LAMBDA("divu_flatten", obx, lbx,
+      {
+          divu_flatten(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                       AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                       AMREX_ZFILL(dx.data()),
+                       AMREX_ARR4_TO_FORTRAN_ANYD(div),
+                       AMREX_ARR4_TO_FORTRAN_ANYD(flat));
+      });
+
+      // One pair of interface states is reused for all three directions.
 
-          CASTRO_LAUNCH_LAMBDA(ebx[idir], lbx,
+      BaseFab<castro_edge_real> ql_fab(obx, QVAR);
+      Elixir elix_ql = ql_fab.elixir();
+      Array4<castro_edge_real> const ql = ql_fab.array();
+
+      BaseFab<castro_edge_real> qr_fab(obx, QVAR);
+      Elixir elix_qr = qr_fab.elixir();
+      Array4<castro_edge_real> const qr = qr_fab.array();
+
+      FArrayBox q_int_fab(obx, QVAR);
+      Elixir elix_q_int = q_int_fab.elixir();
+      Array4<Real> const q_int = q_int_fab.array();
+
+      FArrayBox flux_fab[3], qe_fab[3];
+
+      Elixir elix_flux[3];
+      Elixir elix_qe[3];
+
+      Array4<Real> flux[3];
+      Array4<Real> qe[3];
+
+      for (int idir = 0; idir < 3; ++idir) {
+
+          const int idir_f = idir + 1;
+
+          const Box& ebx = amrex::surroundingNodes(bx, idir);
+
+          // The zones on either side of the faces of this tile.
+
+          const Box& rbx = amrex::grow(bx, idir, 1);
+
+          flux_fab[idir].resize(ebx, NUM_STATE);
+          elix_flux[idir] = flux_fab[idir].elixir();
+          flux[idir] = flux_fab[idir].array();
+
+          qe_fab[idir].resize(ebx, NGDNV);
+          elix_qe[idir] = qe_fab[idir].elixir();
+          qe[idir] = qe_fab[idir].array();
+
+          if (use_ppm) {
+
+              CASTRO_LAUNCH_LAMBDA("mol_ppm", rbx, lbx,
+              {
+                  mol_ppm(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                          AMREX_ARLIM_ANYD(bx.loVect()), AMREX_ARLIM_ANYD(bx.hiVect()),
+                          idir_f,
+                          AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(flat),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(ql),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(qr));
+              });
+
+          }
+          else {
+
+              CASTRO_LAUNCH_LAMBDA("mol_plm", rbx, lbx,
+              {
+                  mol_plm(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                          AMREX_ARLIM_ANYD(bx.loVect()), AMREX_ARLIM_ANYD(bx.hiVect()),
+                          idir_f,
+                          AMREX_ARR4_TO_FORTRAN_ANYD(q),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(flat),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(ql),
+                          AMREX_ARR4_TO_FORTRAN_ANYD(qr));
+              });
+
+          }
+
+          // Compute the flux, applying the artificial viscosity and the species
+          // normalization, and add it (scaled by stage_dt * dA) to the stored flux.
+
+          CASTRO_LAUNCH_LAMBDA("compute_flux", ebx, lbx,
           {
-              store_flux(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
-                         AMREX_ARR4_TO_FORTRAN_ANYD(fluxes_out[idir]),
-                         AMREX_ARR4_TO_FORTRAN_ANYD(flux[idir]),
-                         AMREX_ARR4_TO_FORTRAN_ANYD(ar[idir]),
-                         dt);
+              compute_flux(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(ql),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(qr),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(flux[idir]),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(q_int),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(qe[idir]),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(qaux),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(div),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(state),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(fluxes_out[idir]),
+                           AMREX_ARR4_TO_FORTRAN_ANYD(ar[idir]),
+                           idir_f, riemann, AMREX_ZFILL(dx.data()),
+                           cartesian, store_fluxes, stage_dt, 1);
           });
 
+          if (level > 0)
+              add_to_flux_register(mfi, idir, ebx, flux[idir], ar[idir], stage_dt);
+
       }
 
-      // Construct the conservative update source term.
+      // Add the flux divergence of this stage to the source term.
 
-      CASTRO_LAUNCH_LAMBDA(bx, lbx,
+      CASTRO_LAUNCH_LAMBDA("fill_hydro_source", bx, lbx,
       {
           fill_hydro_source(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
                             AMREX_ARR4_TO_FORTRAN_ANYD(state),
@@ -391,9 +730,57 @@ Castro::construct_hydro_source(Real dt)
                             AMREX_ARR4_TO_FORTRAN_ANYD(ar[1]),
                             AMREX_ARR4_TO_FORTRAN_ANYD(ar[2]),
                             AMREX_ARR4_TO_FORTRAN_ANYD(vol),
+                            cartesian,
                             AMREX_ZFILL(dx.data()), dt);
       });
 
   } // MFIter loop
 
+  thread_loop_done(region_start);
+  }
+
+  thread_region_done();
+
+}
+
+
+
+void
+Castro::add_to_flux_register(const MFIter& mfi, int idir, const Box& ebx,
+                             Array4<Real> const flux, Array4<Real> const area, Real dt)
+{
+    // This is FluxRegister::FineAdd for one tile: only the faces on the
+    // boundary of the grid contribute, so the fine fluxes never have to
+    // be stored for the whole level.
+
+    const Box& gbx = grids[mfi.index()];
+
+    const int idir_f = idir + 1;
+    const int ncomp = FirstSpec + num_active_species;
+    const int cartesian = geom.IsCartesian();
+    const IntVect ratio = crse_ratio;
+
+    auto dx = geom.CellSizeArray();
+
+    for (int side = 0; side < 2; ++side) {
+
+        const Orientation face(idir, side == 0 ? Orientation::low : Orientation::high);
+
+        const Box fbx = ebx & (side == 0 ? amrex::bdryLo(gbx, idir) : amrex::bdryHi(gbx, idir));
+
+        if (!fbx.ok()) continue;
+
+        Array4<Real> const reg = flux_reg[face][mfi].array();
+
+        CASTRO_LAUNCH_LAMBDA("flux_reg_add", fbx, lbx,
+        {
+            flux_reg_add(AMREX_ARLIM_ANYD(lbx.loVect()), AMREX_ARLIM_ANYD(lbx.hiVect()),
+                         idir_f, AMREX_ZFILL(dx.data()),
+                         AMREX_ARR4_TO_FORTRAN_ANYD(flux),
+                         AMREX_ARR4_TO_FORTRAN_ANYD(area),
+                         AMREX_ARR4_TO_FORTRAN_ANYD(reg),
+                         ratio.getVect(), ncomp, cartesian, dt);
+        });
+
+    }
 }
@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <string>
 
 #include <AMReX_LevelBld.H>
 #include <AMReX_ParmParse.H>
@@ -24,21 +25,43 @@ void denfill(BL_FORT_FAB_ARG(state),
 
 typedef StateDescriptor::BndryFunc BndryFunc;
 
+// Lower-case element symbol for an even proton number Z, for naming
+// the alpha-chain species.
+
+static std::string
+alpha_chain_symbol (int Z)
+{
+    static const char* symbols[] = { "he", "be", "c",  "o",  "ne", "mg", "si", "s",  "ar", "ca",
+                                     "ti", "cr", "fe", "ni", "zn", "ge", "se", "kr", "sr", "zr",
+                                     "mo", "ru", "pd", "cd", "sn", "te", "xe", "ba", "ce", "nd",
+                                     "sm", "gd", "dy", "er", "yb", "hf", "w",  "os", "pt", "hg",
+                                     "pb", "po", "rn", "ra", "th", "u",  "pu", "cm", "cf", "fm",
+                                     "no", "rf", "sg", "hs", "ds", "cn", "fl", "lv", "og" };
+
+    return symbols[Z / 2 - 1];
+}
+
 void
 Castro::variableSetUp()
 {
     BL_PROFILE("Castro::variableSetUp()");
 
     // Castro::variableSetUp is called in the constructor of Amr.cpp, so
-    // it will get called when we start the job.
+    // it will get called when we start the job. In ensemble runs every
+    // member builds its own Amr, but they all share one set of data
+    // descriptors and one EOS, so we only set these up the first time.
+
+    if (num_hierarchies++ > 0) return;
 
     BL_ASSERT(desc_lst.size() == 0);
 
     int bndry_func_thread_safe = 1;
     StateDescriptor::setBndryFuncThreadSafety(bndry_func_thread_safe);
 
-    // Initialize the EOS
+    // Initialize the EOS (this reads the Helmholtz table)
+    const Real table_start = ParallelDescriptor::second();
     eos_init();
+    startup_phase_done(TableLoad_Startup, table_start);
 
     Interpolater* interp = &cell_cons_interp;
 
@@ -69,24 +92,93 @@ Castro::variableSetUp()
     cnt++; bcs[cnt] = bc; name[cnt] = "zmom";
     cnt++; bcs[cnt] = bc; name[cnt] = "rho_E";
     cnt++; bcs[cnt] = bc; name[cnt] = "rho_e";
+
+    // The species are the first NumSpec members of the alpha chain
+    // (see network.F90), so we generate their names from Z and A.
+
+    static_assert(NumSpec >= 1 && 2 * (NumSpec + 1) <= 118, "NSPEC must be between 1 and 58");
+
+    for (int n = 0; n < NumSpec; ++n)
+    {
+        const int Z = (n == 0) ? 2 : 2 * (n + 2);
+        const int A = 2 * Z;
+
+        cnt++; bcs[cnt] = bc; name[cnt] = "rho_" + alpha_chain_symbol(Z) + std::to_string(A);
+    }
+
+    // The temperature comes last: it is only an initial guess for the
+    // EOS, so the hydro update and FillPatch can leave it out.
+
     cnt++; bcs[cnt] = bc; name[cnt] = "Temp";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_he4";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_c12";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_o16";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_ne20";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_mg24";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_si28";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_s32";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_ar36";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_ca40";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_ti44";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_cr48";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_fe52";
-    cnt++; bcs[cnt] = bc; name[cnt] = "rho_ni56";
 
     desc_lst.setComponent(State_Type, Density, name, bcs, BndryFunc(denfill, hypfill));
 
     // Update the diagnostic interval.
     ParmParse pp;
     pp.query("diagnostic_interval", diagnostic_interval);
+
+    // Choose the memory layout used by the EOS-heavy kernels.
+    pp.query("aos_eos", aos_eos);
+
+    // EOS Newton iteration statistics and solver strategy.
+    pp.query("eos_stats", eos_stats);
+    pp.query("eos_bracketed_newton", eos_bracketed_newton);
+    pp.query("eos_temp_extrapolation", eos_temp_extrapolation);
+
+    eos_set_bracketed_newton(eos_bracketed_newton);
+
+    // Cheaper logarithms in the EOS, optionally checked against the reference.
+    pp.query("eos_fast_math", eos_fast_math);
+    pp.query("eos_validate", eos_validate);
+
+    if (eos_validate)
+        validate_eos();
+
+    eos_set_fast_math(eos_fast_math);
+
+    // Choose the Riemann solver.
+    pp.query("riemann_solver", riemann_solver);
+
+    if (riemann_solver != 0 && riemann_solver != 1)
+        amrex::Abort("riemann_solver must be 0 (CGF) or 1 (HLLC)");
+
+    // Choose the interface reconstruction.
+    pp.query("ppm_type", ppm_type);
+
+    if (ppm_type != 0 && ppm_type != 1)
+        amrex::Abort("ppm_type must be 0 (PLM) or 1 (PPM)");
+
+    // Choose the hydrodynamics integrator.
+    pp.query("do_ctu", do_ctu);
+
+    if (do_ctu != 0 && do_ctu != 1)
+        amrex::Abort("do_ctu must be 0 (MOL with RK2) or 1 (CTU)");
+
+    // Regrid scheduling.
+    pp.query("adaptive_regrid", adaptive_regrid);
+    pp.query("regrid_margin", regrid_margin);
+
+    // Tile scheduling over OpenMP threads.
+    pp.query("dynamic_tiling", dynamic_tiling);
+    pp.query("thread_timing", thread_timing);
+
+    // Memory placement for CPU runs.
+    pp.query("numa_first_touch", numa_first_touch);
+    pp.query("huge_pages", huge_pages);
+
+    // Timing of the AMR phases.
+    pp.query("amr_timing", amr_timing);
+
+    // Statistics of the ghost zone exchange.
+    pp.query("comm_stats", comm_stats);
+
+    // Active species tracking. Without it, all species are always active.
+    // With it, none are until post_init (or post_restart) has looked at
+    // the data. The C++ count and the Fortran nspec_active are set here
+    // together, so that they agree from the start.
+    pp.query("active_species", active_species);
+
+    num_active_species = active_species ? 0 : NumSpec;
+
+    set_active_species(num_active_species);
 }
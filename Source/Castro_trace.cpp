@@ -0,0 +1,172 @@
+#include <Castro_trace.H>
+
+#include <AMReX_ParallelDescriptor.H>
+#include <AMReX_ParmParse.H>
+#include <AMReX_Print.H>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#ifdef AMREX_USE_OMP
+#include <omp.h>
+#endif
+
+using namespace amrex;
+
+int CastroTrace::enabled = 0;
+int CastroTrace::buffer_size = 65536;
+std::string CastroTrace::trace_file = "mini-Castro_trace.json";
+Real CastroTrace::start_time = 0.0;
+Vector<TraceBuffer> CastroTrace::buffers;
+
+void
+CastroTrace::init ()
+{
+    ParmParse pp;
+
+    pp.query("trace", enabled);
+    pp.query("trace_buffer_size", buffer_size);
+    pp.query("trace_file", trace_file);
+
+    if (!enabled) return;
+
+    if (buffer_size < 1)
+        amrex::Abort("trace_buffer_size must be positive");
+
+#ifdef AMREX_USE_OMP
+    const int nthreads = omp_get_max_threads();
+#else
+    const int nthreads = 1;
+#endif
+
+    buffers.resize(nthreads);
+
+    // Each thread allocates (and first touches) its own buffer.
+
+#ifdef AMREX_USE_OMP
+#pragma omp parallel
+#endif
+    {
+#ifdef AMREX_USE_OMP
+        const int tid = omp_get_thread_num();
+#else
+        const int tid = 0;
+#endif
+        buffers[tid].events.resize(buffer_size);
+    }
+
+    // Line up the time axes of the ranks.
+
+    ParallelDescriptor::Barrier();
+
+    start_time = ParallelDescriptor::second();
+}
+
+Real
+CastroTrace::now ()
+{
+    return ParallelDescriptor::second();
+}
+
+void
+CastroTrace::record (const char* name, int category, Real start, Real end)
+{
+#ifdef AMREX_USE_OMP
+    const int tid = omp_get_thread_num();
+#else
+    const int tid = 0;
+#endif
+
+    if (tid >= static_cast<int>(buffers.size())) return;
+
+    TraceBuffer& buffer = buffers[tid];
+
+    TraceEvent& event = buffer.events[buffer.num_events % buffer_size];
+
+    event.name = name;
+    event.category = category;
+    event.start = start;
+    event.end = end;
+
+    ++buffer.num_events;
+}
+
+void
+CastroTrace::finalize ()
+{
+    if (!enabled) return;
+
+    const int myproc = ParallelDescriptor::MyProc();
+    const int nprocs = ParallelDescriptor::NProcs();
+
+    Long dropped = 0;
+
+    // The ranks append their events to the file in turn.
+
+    for (int rank = 0; rank < nprocs; ++rank) {
+
+        if (rank == myproc) {
+
+            std::ofstream ofs(trace_file, rank == 0 ? std::ios::trunc : std::ios::app);
+
+            if (!ofs.good())
+                amrex::Abort("Could not open the trace file " + trace_file);
+
+            ofs << std::fixed << std::setprecision(3);
+
+            if (rank == 0)
+                ofs << "{\"traceEvents\":[" << std::endl;
+            else
+                ofs << "," << std::endl;
+
+            ofs << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << myproc
+                << ",\"args\":{\"name\":\"rank " << myproc << "\"}}";
+
+            for (int tid = 0; tid < static_cast<int>(buffers.size()); ++tid) {
+
+                ofs << "," << std::endl
+                    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << myproc << ",\"tid\":" << tid
+                    << ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+
+                // Write the events still in the ring buffer, oldest first.
+
+                const Long last = buffers[tid].num_events;
+                const Long first = std::max(static_cast<Long>(0), last - buffer_size);
+
+                dropped += first;
+
+                for (Long n = first; n < last; ++n) {
+
+                    const TraceEvent& event = buffers[tid].events[n % buffer_size];
+
+                    ofs << "," << std::endl
+                        << "{\"name\":\"" << event.name << "\",\"cat\":\""
+                        << (event.category == Trace_Kernel ? "kernel" : "phase")
+                        << "\",\"ph\":\"X\",\"pid\":" << myproc << ",\"tid\":" << tid
+                        << ",\"ts\":" << 1.0e6 * (event.start - start_time)
+                        << ",\"dur\":" << 1.0e6 * (event.end - event.start) << "}";
+
+                }
+
+            }
+
+            if (rank == nprocs - 1)
+                ofs << std::endl << "]}" << std::endl;
+
+        }
+
+        ParallelDescriptor::Barrier();
+
+    }
+
+    ParallelDescriptor::ReduceLongSum(dropped);
+
+    amrex::Print() << "Wrote the timeline trace to " << trace_file << std::endl;
+    if (dropped > 0)
+        amrex::Print() << "The oldest " << dropped << " events did not fit in the trace buffers"
+                       << " (trace_buffer_size = " << buffer_size << " per thread)." << std::endl;
+    amrex::Print() << std::endl;
+
+    buffers.clear();
+}
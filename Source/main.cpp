@@ -49,17 +49,97 @@ main (int argc, char* argv[])
                           "for min_box_size and max_box_size usually must be empirically determined by trying" << std::endl <<
                           "multiple values and finding the fastest run time." << std::endl;
         amrex::Print() << std::endl;
+        amrex::Print() << "Setting max_box_size = auto chooses max_box_size (and min_box_size, unless it is given)" << std::endl <<
+                          "from a model of the ghost zone overhead, the work per MPI rank and thread, and the memory" << std::endl <<
+                          "of each rank (max_rank_memory in GB; by default the GPU memory, or on Linux the node" << std::endl <<
+                          "memory shared by its ranks). The candidates, the choice and its predicted memory use per" << std::endl <<
+                          "rank are printed. Setting auto_box_calibration = N also runs N steps with each of the three" << std::endl <<
+                          "best modeled candidates and chooses the fastest." << std::endl;
+        amrex::Print() << std::endl;
         amrex::Print() << "The simulation prints a Figure of Merit at the end which measures the simulation throughput." << std::endl;
         amrex::Print() << "The FOM measures the average number of zones advanced per microsecond (higher is better)." << std::endl;
         amrex::Print() << "To disable printing the FOM, set fom = 0." << std::endl;
         amrex::Print() << std::endl;
         amrex::Print() << "To track the state of the simulation, the effective radius of the blast wave is periodically calculated and printed." << std::endl;
+        amrex::Print() << "The time to set up the run is printed before the first step, split into loading the EOS table," << std::endl <<
+                          "creating the grids, initializing the data, averaging down and computing the first timestep." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "Setting aos_eos = 1 runs the EOS-heavy kernels (state cleaning, timestep estimation and" << std::endl <<
+                          "the conversion to primitive variables) on a zone-interleaved copy of the state." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "Setting eos_stats = 1 prints the number of EOS Newton iterations in every step, and a" << std::endl <<
+                          "histogram of iterations per call for each kernel at the end (CPU builds only)." << std::endl <<
+                          "Setting eos_bracketed_newton = 1 uses a safeguarded Newton iteration that keeps a bracket" << std::endl <<
+                          "on the temperature and takes larger steps, instead of limiting each step to a factor of two." << std::endl <<
+                          "Setting eos_temp_extrapolation = 1 starts the EOS inversion after the update from a temperature" << std::endl <<
+                          "extrapolated linearly from the last two steps, instead of the temperature at the start of the step." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "Setting eos_fast_math = 1 uses a cheaper logarithm for the EOS table lookup and the ion entropy;" << std::endl <<
+                          "only the entropy changes (by less than 2e-9 k_B N_A / abar). Setting eos_validate = 1 compares it with the" << std::endl <<
+                          "reference EOS across the table at startup and times both (CPU builds only)." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "riemann_solver (0): The Riemann solver; 0 is the Colella-Glaz-Ferguson two-shock solver," << std::endl <<
+                          "and 1 is the cheaper but more diffusive HLLC solver." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "ppm_type (1): The interface reconstruction; 1 is the piecewise parabolic method (PPM)," << std::endl <<
+                          "and 0 is the cheaper piecewise linear method (PLM) with MC-limited slopes." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "do_ctu (1): The hydrodynamics integrator; 1 is the corner transport upwind (CTU) scheme," << std::endl <<
+                          "and 0 is a method-of-lines (MOL) update with second-order Runge-Kutta, which does much less" << std::endl <<
+                          "work per stage but takes two stages per step and a smaller timestep (CFL 1/3 instead of 1/2)." << std::endl <<
+                          "Compare the time to solution printed at the end for the same stop_time." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "Setting adaptive_regrid = 1 (with max_level > 0) checks after every step whether a zone tagged" << std::endl <<
+                          "for refinement is within regrid_margin (1) zones of the edge of the finer level," << std::endl <<
+                          "and only regrids when one is. The number of regrids and their cost are printed at the end." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "do_subcycle (1): With max_level > 0, advance each finer level with ref_ratio smaller timesteps" << std::endl <<
+                          "per step of the level below it. Setting do_subcycle = 0 advances all levels together with one" << std::endl <<
+                          "timestep, limited by the finest level, so that each level is filled, refluxed and averaged" << std::endl <<
+                          "down once per step. Compare the two with amr_timing = 1 and the AMR efficiency FOM." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "dynamic_tiling (0): With OpenMP, hand out the tiles of the hydro, state cleaning and timestep" << std::endl <<
+                          "loops to threads on demand instead of with a fixed assignment. Setting thread_timing = 1" << std::endl <<
+                          "prints each thread's busy time and barrier wait time in these loops at the end." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "For CPU runs, setting numa_first_touch = 1 first touches every newly allocated MultiFab" << std::endl <<
+                          "tile by tile on the thread that computes on it (this uses static tile scheduling)," << std::endl <<
+                          "and setting huge_pages = 1 requests transparent huge pages for the MultiFab data." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "exp_energy (1.e52): The explosion energy in erg. Setting ensemble_size (1) to N > 1 advances" << std::endl <<
+                          "N independent copies of the problem in one run, one coarse timestep of each in turn;" << std::endl <<
+                          "exp_energy may then be given one value per member. The diagnostics and a summary at the" << std::endl <<
+                          "end are printed for each member, and the FOM is the aggregate over all members." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "Setting amr_timing = 1 prints, for each level, the time spent in and the state data moved by" << std::endl <<
+                          "FillPatch, the hydro, the flux registers, reflux, average down, the post-step cleaning and" << std::endl <<
+                          "regridding at the end; amr_timing = 2 also prints this after every coarse step. With" << std::endl <<
+                          "max_level > 0 an AMR efficiency FOM is printed, counting the zones a uniform grid at the" << std::endl <<
+                          "finest resolution would have advanced, to judge whether the refinement pays off." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "active_species (0): Set to 1 to only carry the species that are not negligible somewhere (initially" << std::endl <<
+                          "only he4) through the hydro update, FillPatch and refluxing. The check is repeated every coarse" << std::endl <<
+                          "step, so a species is added as soon as it appears. By default all species are always carried." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "Setting comm_stats = 1 prints, after every coarse step and at the end, the bytes and messages" << std::endl <<
+                          "each rank sends in the ghost zone exchange of the FillPatch (modeled from the grid layout," << std::endl <<
+                          "average and maximum over the ranks), the measured time spent in it, and the fraction of the" << std::endl <<
+                          "full state that is sent. Only the active species are exchanged, and the temperature is" << std::endl <<
+                          "recomputed in the ghost zones instead." << std::endl;
+        amrex::Print() << std::endl;
+        amrex::Print() << "Setting trace = 1 records a timeline of the advance, FillPatch, clean_state, hydro, reflux," << std::endl <<
+                          "average down, timestep and blast radius phases (with their MPI reductions) and of every" << std::endl <<
+                          "kernel launch on each rank and thread, and writes it at the end to trace_file" << std::endl <<
+                          "(mini-Castro_trace.json) in the Chrome trace-event format. Each thread keeps the last" << std::endl <<
+                          "trace_buffer_size (65536) events." << std::endl;
         amrex::Print() << std::endl;
     }
     else
     {
         amrex::Print() << std::endl << "Starting mini-Castro..." << std::endl << std::endl;
 
+        CastroTrace::init();
+
         int max_step = 10000000;
         amrex::Real stop_time = 1.0e-2;
         int do_fom = 1;
@@ -91,17 +171,19 @@ main (int argc, char* argv[])
         std::vector<int> n_cell_arr{n_cell, n_cell, n_cell};
         pp_amr.addarr("n_cell", n_cell_arr);
 
-        // Use max_box_size to replace amr.max_grid_size.
+        // Use max_box_size to replace amr.max_grid_size, and min_box_size
+        // to replace amr.blocking_factor. These are set further down,
+        // since with max_box_size = auto they are chosen for the run.
 
-        int max_box_size = 64;
-        pp.query("max_box_size", max_box_size);
-        pp_amr.add("max_grid_size", max_box_size);
+        std::string max_box_size_str = "64";
+        pp.query("max_box_size", max_box_size_str);
 
-        // Use min_box_size to replace amr.blocking_factor.
+        const bool auto_box_size = (max_box_size_str == "auto");
+
+        int max_box_size = auto_box_size ? 0 : std::stoi(max_box_size_str);
 
         int min_box_size = 16;
-        pp.query("min_box_size", min_box_size);
-        pp_amr.add("blocking_factor", min_box_size);
+        const bool fixed_min_box_size = pp.query("min_box_size", min_box_size);
 
         // Use max_level to replace amr.max_level.
 
@@ -109,46 +191,176 @@ main (int argc, char* argv[])
         pp.query("max_level", max_level);
         pp_amr.add("max_level", max_level);
 
+        // With adaptive_regrid, check whether to regrid after every step;
+        // Castro::okToRegrid decides whether the regrid is needed.
+
+        int adaptive_regrid = 0;
+        pp.query("adaptive_regrid", adaptive_regrid);
+        if (adaptive_regrid && !pp_amr.contains("regrid_int"))
+            pp_amr.add("regrid_int", 1);
+
+        // By default every finer level takes ref_ratio steps, each with its
+        // own timestep, for every step of the level below it. With
+        // do_subcycle = 0 all levels instead advance together with the
+        // timestep of the most restrictive level, so that every level is
+        // filled, refluxed and averaged down once per coarse step.
+
+        int do_subcycle = 1;
+        pp.query("do_subcycle", do_subcycle);
+        if (!do_subcycle)
+            pp_amr.add("subcycling_mode", std::string("None"));
+
+        // An ensemble run advances ensemble_size independent copies of the
+        // problem in this process, each with its own explosion energy.
+
+        int ensemble_size = 1;
+        pp.query("ensemble_size", ensemble_size);
+
+        if (ensemble_size < 1)
+            amrex::Abort("ensemble_size must be at least 1");
+
+        std::vector<amrex::Real> exp_energy{Castro::exp_energy};
+        pp.queryarr("exp_energy", exp_energy);
+
+        if (exp_energy.size() == 1)
+            exp_energy.resize(ensemble_size, exp_energy[0]);
+        else if (static_cast<int>(exp_energy.size()) != ensemble_size)
+            amrex::Abort("exp_energy must have either one value or one value per ensemble member");
+
+        if (auto_box_size) {
+            Castro::exp_energy = exp_energy[0];
+            Castro::choose_decomposition(n_cell, stop_time, max_box_size, min_box_size, fixed_min_box_size);
+        }
+
+        pp_amr.add("max_grid_size", max_box_size);
+        pp_amr.add("blocking_factor", min_box_size);
+
         amrex::Print() << "Initializing AMR driver using the following runtime parameters:" << std::endl << std::endl;
         amrex::Print() << "n_cell = " << n_cell << std::endl;
         amrex::Print() << "max_box_size = " << max_box_size << std::endl;
         amrex::Print() << "min_box_size = " << min_box_size << std::endl;
         amrex::Print() << "max_level = " << max_level << std::endl;
+        if (max_level > 0) {
+            amrex::Print() << "do_subcycle = " << do_subcycle << std::endl;
+        }
         amrex::Print() << "max_step = " << max_step << std::endl;
         amrex::Print() << "stop_time = " << stop_time << std::endl;
+        amrex::Print() << "number of species (NSPEC) = " << NumSpec << std::endl;
+        if (ensemble_size > 1) {
+            amrex::Print() << "ensemble_size = " << ensemble_size << std::endl;
+        }
+        amrex::Print() << "exp_energy =";
+        for (amrex::Real e : exp_energy) {
+            amrex::Print() << " " << e;
+        }
+        amrex::Print() << std::endl;
         amrex::Print() << std::endl;
 
-        amrex::Amr* amrptr = new amrex::Amr;
+        // Every member builds its own Amr hierarchy; the data descriptors
+        // and the EOS are set up once and shared between them.
+
+        amrex::Real startup_time = amrex::ParallelDescriptor::second();
+
+        std::vector<amrex::Amr*> members(ensemble_size);
+
+        for (int m = 0; m < ensemble_size; ++m) {
+            members[m] = new amrex::Amr;
+        }
 
         amrex::Print() << "Running simulation and calculating diagnostics every " << Castro::diagnostic_interval << " timesteps..." << std::endl << std::endl;
 
-        amrptr->init(0.0, stop_time);
+        for (int m = 0; m < ensemble_size; ++m) {
+            Castro::ensemble_member = ensemble_size > 1 ? m : -1;
+            Castro::exp_energy = exp_energy[m];
+            members[m]->init(0.0, stop_time);
+        }
+
+        startup_time = amrex::ParallelDescriptor::second() - startup_time;
+
+        Castro::print_startup_timing(startup_time);
+
+        std::vector<amrex::Real> member_time(ensemble_size, 0.0);
+        std::vector<amrex::Real> member_zones(ensemble_size, 0.0);
 
         amrex::Real dRunTime1 = amrex::ParallelDescriptor::second();
 
-        while ( amrptr->okToContinue()                            &&
-               (amrptr->levelSteps(0) < max_step || max_step < 0) &&
-               (amrptr->cumTime() < stop_time || stop_time < 0.0) )
+        // Advance the members in turn, one coarse timestep each, until all
+        // of them are done. Within a timestep the work of the member is
+        // spread over the threads by the tiled MFIter loops. The members
+        // can't run concurrently on different threads: an MFIter outside a
+        // nested parallel region would split its tiles over the threads of
+        // the ensemble loop, and the Castro statics (zone counters, timers,
+        // the member label and the EOS and trace buffers) are shared by all
+        // members.
+
+        int num_running = ensemble_size;
+
+        while (num_running > 0)
         {
-            //
-            // Do a timestep.
-            //
-            amrptr->coarseTimeStep(stop_time);
+            num_running = 0;
+
+            for (int m = 0; m < ensemble_size; ++m)
+            {
+                amrex::Amr* amrptr = members[m];
+
+                if ( amrptr->okToContinue()                            &&
+                    (amrptr->levelSteps(0) < max_step || max_step < 0) &&
+                    (amrptr->cumTime() < stop_time || stop_time < 0.0) )
+                {
+                    Castro::ensemble_member = ensemble_size > 1 ? m : -1;
 
+                    amrex::Real step_start_time = amrex::ParallelDescriptor::second();
+                    amrex::Real step_start_zones = Castro::num_zones_advanced;
+
+                    //
+                    // Do a timestep.
+                    //
+                    amrptr->coarseTimeStep(stop_time);
+
+                    member_time[m] += amrex::ParallelDescriptor::second() - step_start_time;
+                    member_zones[m] += Castro::num_zones_advanced - step_start_zones;
+
+                    ++num_running;
+                }
+            }
         }
 
-        int nsteps = amrptr->levelSteps(0);
+        // Stop the clock here, so that the Figure of Merit only covers the
+        // timesteps, not the diagnostics and teardown below.
+
+        amrex::Real dRunTime2 = amrex::ParallelDescriptor::second();
+
+        int nsteps = 0;
+        std::vector<int> member_steps(ensemble_size);
+        std::vector<amrex::Real> member_radius(ensemble_size);
+        std::vector<amrex::Real> member_end_time(ensemble_size);
+
+        for (int m = 0; m < ensemble_size; ++m) {
+            member_steps[m] = members[m]->levelSteps(0);
+            member_end_time[m] = members[m]->cumTime();
+            nsteps += member_steps[m];
+            if (ensemble_size > 1) {
+                member_radius[m] = static_cast<Castro&>(members[m]->getLevel(0)).blast_radius();
+            }
+        }
 
         // Start calculating the figure of merit for this run: average number of zones
         // advanced per microsecond. This must be done before we delete the Amr
-        // object because we need to scale it by the number of zones on the coarse grid.
+        // objects because we need to scale it by the number of zones on the coarse grid,
+        // which is the same for all ensemble members.
 
-        long numPtsCoarseGrid = amrptr->getLevel(0).boxArray().numPts();
+        long numPtsCoarseGrid = members[0]->getLevel(0).boxArray().numPts();
         amrex::Real fom = Castro::num_zones_advanced * numPtsCoarseGrid;
 
-        delete amrptr;
+        // The AMR efficiency figure of merit instead counts the zones a uniform
+        // grid at the finest resolution would have advanced in the same time,
+        // so it includes the cost of the AMR synchronization and regridding.
 
-        amrex::Real dRunTime2 = amrex::ParallelDescriptor::second();
+        amrex::Real fom_equivalent = Castro::num_zones_equivalent * numPtsCoarseGrid;
+
+        for (int m = 0; m < ensemble_size; ++m) {
+            delete members[m];
+        }
 
         amrex::Real runtime = dRunTime2 - dRunTime1;
 
@@ -156,15 +368,69 @@ main (int argc, char* argv[])
         amrex::ParallelDescriptor::ReduceRealMax(runtime, IOProc);
 
         fom = fom / runtime / 1.e6;
+        fom_equivalent = fom_equivalent / runtime / 1.e6;
 
         amrex::Print() << std::endl;
         amrex::Print() << "Simulation completed!" << std::endl;
         amrex::Print() << "Number of timesteps taken: " << nsteps << std::endl;
         amrex::Print() << std::endl;
+        amrex::Print() << "Hydrodynamics integrator: " << (Castro::do_ctu ? "CTU" : "MOL with RK2") << std::endl;
+        amrex::Print() << "Time to solution (s): " << std::fixed << std::setprecision(3) << runtime << std::endl;
+        if (ensemble_size == 1) {
+            amrex::Print() << "Final simulation time (s): " << std::scientific << std::setprecision(6) << member_end_time[0] << std::endl;
+        }
+        amrex::Print() << std::endl;
+        if (ensemble_size > 1) {
+            amrex::ParallelDescriptor::ReduceRealMax(member_time.data(), ensemble_size, IOProc);
+            amrex::Print() << "Ensemble member  Explosion energy (erg)  Timesteps  Final time (s)  Final blast radius (km)  Zones / usec" << std::endl;
+            for (int m = 0; m < ensemble_size; ++m) {
+                amrex::Real member_fom = member_time[m] > 0.0 ? member_zones[m] * numPtsCoarseGrid / member_time[m] / 1.e6 : 0.0;
+                amrex::Print() << std::setw(15) << m << "  "
+                               << std::scientific << std::setprecision(3) << std::setw(22) << exp_energy[m] << "  "
+                               << std::setw(9) << member_steps[m] << "  "
+                               << std::setw(14) << member_end_time[m] << "  "
+                               << std::fixed << std::setw(23) << member_radius[m] / 1.0e5 << "  "
+                               << std::setw(12) << member_fom << std::endl;
+            }
+            amrex::Print() << std::endl;
+            if (do_fom) {
+                amrex::Print() << "The Figure of Merit is the aggregate throughput of all ensemble members." << std::endl;
+            }
+        }
         if (do_fom) {
             amrex::Print() << "Figure of Merit (zones / usec): " << std::fixed << std::setprecision(3) << fom << "\n";
             amrex::Print() << std::endl;
         }
+        if (Castro::eos_stats) {
+            Castro::print_eos_stats();
+        }
+        if (Castro::thread_timing) {
+            Castro::print_thread_timing();
+        }
+        if (max_level > 0) {
+            amrex::Real regrid_time = Castro::regrid_time;
+            amrex::ParallelDescriptor::ReduceRealMax(regrid_time, IOProc);
+            amrex::Print() << "Number of regrids: " << Castro::num_regrids << std::endl;
+            amrex::Print() << "Time spent regridding (s): " << std::fixed << std::setprecision(3) << regrid_time << std::endl;
+            amrex::Real tag_fill_time = Castro::tag_fill_time;
+            amrex::ParallelDescriptor::ReduceRealMax(tag_fill_time, IOProc);
+            amrex::Print() << "Density fills for tagging: " << Castro::num_tag_fills
+                           << ", time (s): " << std::fixed << std::setprecision(3) << tag_fill_time << std::endl;
+            amrex::Print() << std::endl;
+            if (do_fom) {
+                amrex::Print() << "AMR efficiency Figure of Merit (uniform finest-level zones / usec): "
+                               << std::fixed << std::setprecision(3) << fom_equivalent << std::endl;
+                amrex::Print() << std::endl;
+            }
+        }
+        if (Castro::amr_timing) {
+            Castro::print_amr_timing(runtime);
+        }
+        if (Castro::comm_stats) {
+            Castro::print_comm_stats();
+        }
+
+        CastroTrace::finalize();
 
     }
 